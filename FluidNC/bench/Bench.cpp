@@ -0,0 +1,628 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+/*
+  Bench.cpp - native throughput benchmark of the motion pipeline
+
+  Feeds a G-code program through the real gc_execute_line() ->
+  mc_linear() -> plan_buffer_line() -> Stepper::prep_buffer() ->
+  Stepper::pulse_func() path and reports the rate of each stage, so that
+  parser and planner regressions show up before they starve the segment
+  buffer on dense CAM files.
+
+  Usage: bench [-c config.yaml] [-r repeat] [-b blocks] [-t steps.trace] [-a] [-e] [-p] [-w file.gcb] [-j] [file.nc]
+
+  Without a file, a dense spiral of short G1 moves is generated, or with
+  -a, a helical ramp of G2 arcs.  The program is read into memory first,
+  so file I/O is not measured.
+
+  -b overrides planner_blocks, to measure how the cost of the
+  look-ahead grows with its length.
+
+  -t selects the Capture step engine, which writes a timeline of every
+  step, direction and timer change to the given file.  See
+  capture_engine.cpp for the format.
+
+  -e runs the job time estimator over the program first, so that its
+  estimate can be compared with the simulated motion time.
+
+  -p only splits each line into words, with gc_lex_line() and with
+  collapseGCode() and read_number(), checks that both give the same
+  words, and reports the time per line of each and per number, and
+  the time to compile and to evaluate each [] expression.
+
+  -w converts the program to a precompiled .gcb file, as $SD/Compile does
+  on the machine, and exits.  A .gcb file given as the program is run
+  through gc_execute_words(), as BinaryInputFile runs it.
+
+  -j runs the program file as a file job, reading it with InputFile or
+  BinaryInputFile as $SD/Run does, so that flow control loops work.
+*/
+
+#include "src/BinaryInputFile.h"
+#include "src/Channel.h"
+#include "src/Estimator.h"
+#include "src/Expression.h"
+#include "src/GCode.h"
+#include "src/GCodeBinary.h"
+#include "src/GCodeLexer.h"
+#include "src/Job.h"
+#include "src/Limits.h"
+#include "src/MotionControl.h"
+#include "src/Parameters.h"
+#include "src/Planner.h"
+#include "src/Protocol.h"
+#include "src/Serial.h"
+#include "src/Stepper.h"
+#include "src/System.h"
+#include "src/Machine/MachineConfig.h"
+#include "src/Spindles/Spindle.h"
+#include "Bench.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// The machine used when no configuration file is given.  The step pins
+// make the step engine do the same per-motor work as on real hardware.
+static const char* defaultConfig = R"(
+name: Bench
+stepping:
+  engine: Timed
+  segments: 12
+  pulse_us: 2
+axes:
+  x:
+    steps_per_mm: 80
+    max_rate_mm_per_min: 6000
+    acceleration_mm_per_sec2: 500
+    max_travel_mm: 1000
+    motor0:
+      standard_stepper:
+        step_pin: gpio.12
+        direction_pin: gpio.14
+  y:
+    steps_per_mm: 80
+    max_rate_mm_per_min: 6000
+    acceleration_mm_per_sec2: 500
+    max_travel_mm: 1000
+    motor0:
+      standard_stepper:
+        step_pin: gpio.26
+        direction_pin: gpio.15
+  z:
+    steps_per_mm: 400
+    max_rate_mm_per_min: 1500
+    acceleration_mm_per_sec2: 200
+    max_travel_mm: 100
+    motor0:
+      standard_stepper:
+        step_pin: gpio.27
+        direction_pin: gpio.33
+)";
+
+// Log messages go to stdout
+class ConsoleChannel : public Channel {
+public:
+    ConsoleChannel() : Channel("console") {}
+
+    size_t write(uint8_t c) override { return fwrite(&c, 1, 1, stdout); }
+};
+
+static ConsoleChannel console;
+
+extern void make_settings();
+
+static bool read_file(const char* filename, std::string& contents) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    contents = ss.str();
+    return true;
+}
+
+// A helical ramp of quarter circles, which mc_arc() turns into chords
+static void make_helix(std::vector<std::string>& lines) {
+    const int   n_arcs = 4000;
+    const float radius = 20.0f;
+    const float pitch  = 0.1f;  // Z drop per turn
+
+    lines.push_back("G21 G90 G94 G17 F6000");
+    float x = 50.0f + radius;
+    float y = 50.0f;
+    char  buf[80];
+    snprintf(buf, sizeof(buf), "G0 X%.3f Y%.3f Z0", x, y);
+    lines.push_back(buf);
+    for (int i = 1; i <= n_arcs; i++) {
+        float angle = i * float(M_PI) / 2;
+        float i_off = 50.0f - x;
+        float j_off = 50.0f - y;
+        x           = 50.0f + radius * cosf(angle);
+        y           = 50.0f - radius * sinf(angle);
+        snprintf(buf, sizeof(buf), "G2 X%.3f Y%.3f Z%.4f I%.3f J%.3f", x, y, -pitch * i / 4, i_off, j_off);
+        lines.push_back(buf);
+    }
+}
+
+// A finishing-pass-like spiral of 0.05 mm chords with a slowly varying Z
+static void make_spiral(std::vector<std::string>& lines) {
+    const int   n_lines = 100000;
+    const float chord   = 0.05f;
+    float       radius  = 10.0f;
+    float       angle   = 0.0f;
+
+    lines.push_back("G21 G90 G94 F3000");
+    char buf[80];
+    for (int i = 0; i < n_lines; i++) {
+        angle += chord / radius;
+        radius += 0.0005f;
+        float x = 50.0f + radius * cosf(angle);
+        float y = 50.0f + radius * sinf(angle);
+        float z = -1.0f + 0.2f * sinf(angle * 3.0f);
+        snprintf(buf, sizeof(buf), "G1 X%.3f Y%.3f Z%.3f", x, y, z);
+        lines.push_back(buf);
+    }
+}
+
+static void machine_init(const std::string& yaml, uint32_t plannerBlocks, const char* traceFile) {
+    allChannels.registration(&console);
+    make_settings();
+
+    Machine::MachineConfig::load_yaml(yaml);
+    if (state_is(State::ConfigAlarm)) {
+        fprintf(stderr, "Configuration failed\n");
+        exit(1);
+    }
+
+    if (plannerBlocks) {
+        config->_planner_blocks = plannerBlocks;
+    }
+
+    if (traceFile) {
+        if (!Bench::trace_open(traceFile)) {
+            fprintf(stderr, "Cannot create %s\n", traceFile);
+            exit(1);
+        }
+        Stepping::_engine = Stepping::CAPTURE;
+        config->_stepping->afterParse();
+    }
+
+    // The bench drives prep_buffer() itself, on one thread
+    Stepping::_prepTask = false;
+
+    Stepping::init();
+    plan_init();
+    config->_userOutputs->init();
+    config->_userInputs->init();
+    Axes::init();
+    config->_kinematics->init();
+    limits_init();
+
+    auto spindles = Spindles::SpindleFactory::objects();
+    for (auto const& s : spindles) {
+        s->init();
+    }
+    bool stopped_spindle, new_spindle;
+    Spindles::Spindle::switchSpindle(0, spindles, spindle, stopped_spindle, new_spindle);
+    config->_coolant->init();
+    config->_probe->init();
+
+    // The same sequence as protocol_do_soft_restart()
+    system_reset();
+    protocol_reset();
+    gc_init();
+    plan_reset();
+    Stepper::reset();
+    plan_sync_position();
+    gc_sync_position();
+    mc_init();
+    set_state(State::Idle);
+}
+
+// Splits line into words the way gc_execute_line() does when the lexer gives up
+static int collapse_words(char* line, gc_word_t* words) {
+    collapseGCode(line);
+    int    n   = 0;
+    size_t pos = 0;
+    while (line[pos] >= 'A' && line[pos] <= 'Z' && n < MAX_GCODE_WORDS) {
+        words[n].letter = line[pos++];
+        if (!read_number(line, pos, words[n].value)) {
+            break;
+        }
+        ++n;
+    }
+    return n;
+}
+
+// Times both ways of splitting the lines into words
+static int bench_parse(const std::vector<std::string>& lines, int repeat) {
+    gc_word_t    words[MAX_GCODE_WORDS];
+    gc_word_t    expected[MAX_GCODE_WORDS];
+    char         line[LINE_BUFFER_SIZE];
+    size_t       lexed      = 0;
+    size_t       mismatches = 0;
+    volatile int sink       = 0;  // Keeps the loops from being optimized away
+
+    std::vector<std::string> numbers;  // The values of the words in the plain lines
+
+    for (auto const& text : lines) {
+        strncpy(line, text.c_str(), LINE_BUFFER_SIZE - 1);
+        line[LINE_BUFFER_SIZE - 1] = '\0';
+        int n = gc_lex_line(line, words, MAX_GCODE_WORDS);
+        if (n < 0) {
+            continue;
+        }
+        ++lexed;
+        bool same = n == collapse_words(line, expected);
+        for (int i = 0; same && i < n; i++) {
+            same = words[i].letter == expected[i].letter && words[i].value == expected[i].value;
+        }
+        if (!same) {
+            if (mismatches++ < 10) {
+                printf("Mismatch: %s\n", text.c_str());
+            }
+        }
+        for (char* p = line; *p; ++p) {
+            if (*p >= 'A' && *p <= 'Z') {
+                numbers.push_back(p + 1);
+            }
+        }
+    }
+
+    std::vector<std::string> expressions;  // The text from each [ that starts an expression
+
+    for (auto const& text : lines) {
+        strncpy(line, text.c_str(), LINE_BUFFER_SIZE - 1);
+        line[LINE_BUFFER_SIZE - 1] = '\0';
+        collapseGCode(line);
+        if (line[0] == '#') {
+            // Sets the parameter, so that the expressions that read it can be evaluated
+            size_t pos = 1;
+            if (assign_param(line, pos)) {
+                perform_assignments();
+            }
+        }
+        int depth = 0;
+        for (char* p = line; *p; ++p) {
+            if (*p == '[' && depth++ == 0) {
+                expressions.push_back(p);
+            } else if (*p == ']') {
+                --depth;
+            }
+        }
+    }
+
+    uint64_t start = Bench::now_ns();
+    for (int pass = 0; pass < repeat; pass++) {
+        for (auto const& text : lines) {
+            // The copy stands in for the line that collapseGCode() edits in place
+            strncpy(line, text.c_str(), LINE_BUFFER_SIZE - 1);
+            line[LINE_BUFFER_SIZE - 1] = '\0';
+            sink                       = sink + collapse_words(line, expected);
+        }
+    }
+    uint64_t collapse_ns = Bench::now_ns() - start;
+
+    start = Bench::now_ns();
+    for (int pass = 0; pass < repeat; pass++) {
+        for (auto const& text : lines) {
+            sink = sink + gc_lex_line(text.c_str(), words, MAX_GCODE_WORDS);
+        }
+    }
+    uint64_t lex_ns = Bench::now_ns() - start;
+
+    start = Bench::now_ns();
+    for (int pass = 0; pass < repeat; pass++) {
+        for (auto const& number : numbers) {
+            size_t pos = 0;
+            float  value;
+            sink = sink + read_number(number.c_str(), pos, value);
+        }
+    }
+    uint64_t number_ns = Bench::now_ns() - start;
+
+    ngc_expr_t expr;
+    start = Bench::now_ns();
+    for (int pass = 0; pass < repeat; pass++) {
+        for (auto const& text : expressions) {
+            size_t pos = 0;
+            sink       = sink + int(expression_compile(text.c_str(), pos, expr));
+        }
+    }
+    uint64_t compile_ns = Bench::now_ns() - start;
+
+    start = Bench::now_ns();
+    for (int pass = 0; pass < repeat; pass++) {
+        for (auto const& text : expressions) {
+            size_t pos = 0;
+            float  value;
+            sink = sink + int(expression(text.c_str(), pos, value));
+        }
+    }
+    uint64_t expression_ns = Bench::now_ns() - start;
+
+    double n_lines = double(lines.size()) * repeat;
+    printf("\n");
+    printf("Lines      %10zu  %zu plain lines that the lexer handles\n", lines.size(), lexed);
+    printf("Collapse   %10.1f  ns/line            (collapseGCode + read_number)\n", collapse_ns / n_lines);
+    printf("Lexer      %10.1f  ns/line            (gc_lex_line, %.2fx)\n", lex_ns / n_lines, lex_ns ? double(collapse_ns) / lex_ns : 0.0);
+    if (!numbers.empty()) {
+        printf("Numbers    %10.1f  ns/number          (read_number)\n", number_ns / (double(numbers.size()) * repeat));
+    }
+    if (!expressions.empty()) {
+        double n_expressions = double(expressions.size()) * repeat;
+        printf("Compile    %10.1f  ns/expression      (expression_compile, %zu expressions)\n", compile_ns / n_expressions, expressions.size());
+        printf("Expression %10.1f  ns/expression      (expression, compiled once)\n", expression_ns / n_expressions);
+    }
+    if (mismatches) {
+        printf("Mismatches %10zu  lines where the words differ\n", mismatches);
+    }
+    return mismatches ? 1 : 0;
+}
+
+// Calls on_words() for each block of a precompiled program, and on_line() for each line
+// that was kept as text, until one returns false.  Returns false for an invalid record.
+template <typename Words, typename Line>
+static bool for_each_record(const std::string& program, Words on_words, Line on_line) {
+    auto      p   = reinterpret_cast<const uint8_t*>(program.data()) + GCodeBinary::signature_size;
+    auto      end = reinterpret_cast<const uint8_t*>(program.data()) + program.size();
+    gc_word_t words[MAX_GCODE_WORDS];
+    char      text[GCodeBinary::max_text + 1];
+    size_t    blank_lines;
+    int       n_words;
+    while (p != end) {
+        if (!GCodeBinary::decode(p, end, blank_lines, words, n_words, text)) {
+            return false;
+        }
+        if (!(n_words < 0 ? on_line(text) : on_words(words, n_words))) {
+            break;
+        }
+    }
+    return true;
+}
+
+static int write_binary(const std::vector<std::string>& lines, const char* filename) {
+    GCodeBinary::Encoder encoder;
+    size_t               text_bytes = 0;
+    for (auto const& text : lines) {
+        text_bytes += text.length() + 1;
+        if (encoder.line(text.c_str()) != Error::Ok) {
+            fprintf(stderr, "Line too long: %s\n", text.c_str());
+            return 1;
+        }
+    }
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.write(encoder.output.data(), encoder.output.length())) {
+        fprintf(stderr, "Cannot write %s\n", filename);
+        return 1;
+    }
+    printf("Wrote %zu lines, %zu bytes of text as %zu bytes (%.0f%%)\n",
+           lines.size(),
+           text_bytes,
+           encoder.output.length(),
+           text_bytes ? 100.0 * encoder.output.length() / text_bytes : 0.0);
+    return 0;
+}
+
+static double per_sec(uint64_t count, uint64_t ns) {
+    return ns ? count * 1e9 / ns : 0.0;
+}
+
+int main(int argc, char** argv) {
+    const char* configFile = nullptr;
+    const char* gcodeFile  = nullptr;
+    const char* traceFile  = nullptr;
+    int         repeat     = 1;
+    uint32_t    blocks     = 0;
+    bool        arcs       = false;
+    bool        estimate   = false;
+    bool        parse      = false;
+    const char* binaryFile = nullptr;
+    bool        fileJob    = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            configFile = argv[++i];
+        } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+            blocks = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            traceFile = argv[++i];
+        } else if (!strcmp(argv[i], "-a")) {
+            arcs = true;
+        } else if (!strcmp(argv[i], "-e")) {
+            estimate = true;
+        } else if (!strcmp(argv[i], "-p")) {
+            parse = true;
+        } else if (!strcmp(argv[i], "-w") && i + 1 < argc) {
+            binaryFile = argv[++i];
+        } else if (!strcmp(argv[i], "-j")) {
+            fileJob = true;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr,
+                    "Usage: %s [-c config.yaml] [-r repeat] [-b blocks] [-t steps.trace] [-a] [-e] [-p] [-w file.gcb] [-j] [file.nc]\n",
+                    argv[0]);
+            return 1;
+        } else {
+            gcodeFile = argv[i];
+        }
+    }
+
+    std::string yaml = defaultConfig;
+    if (configFile && !read_file(configFile, yaml)) {
+        fprintf(stderr, "Cannot read %s\n", configFile);
+        return 1;
+    }
+
+    std::vector<std::string> lines;
+    std::string              program;
+    bool                     binary = gcodeFile && GCodeBinary::is_binary(gcodeFile);
+    if (gcodeFile) {
+        if (!read_file(gcodeFile, program)) {
+            fprintf(stderr, "Cannot read %s\n", gcodeFile);
+            return 1;
+        }
+        if (binary && program.compare(0, GCodeBinary::signature_size, GCodeBinary::signature) != 0) {
+            fprintf(stderr, "%s is not a precompiled G-code file\n", gcodeFile);
+            return 1;
+        }
+    }
+    if (binary) {
+        // Decoded as it runs
+    } else if (gcodeFile) {
+        std::istringstream in(program);
+        std::string        line;
+        while (std::getline(in, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            lines.push_back(line);
+        }
+    } else if (arcs) {
+        make_helix(lines);
+    } else {
+        make_spiral(lines);
+    }
+
+    if (binaryFile) {
+        return write_binary(lines, binaryFile);
+    }
+    if (fileJob && !gcodeFile) {
+        fprintf(stderr, "-j needs a program file\n");
+        return 1;
+    }
+
+    machine_init(yaml, blocks, traceFile);
+
+    if (parse) {
+        return bench_parse(lines, repeat);
+    }
+
+    char line[LINE_BUFFER_SIZE];
+    if (estimate) {
+        uint64_t start = Bench::now_ns();
+        Estimator::begin();
+        for (int pass = 0; pass < repeat; pass++) {
+            for (auto const& text : lines) {
+                strncpy(line, text.c_str(), LINE_BUFFER_SIZE - 1);
+                line[LINE_BUFFER_SIZE - 1] = '\0';
+                Estimator::execute_line(line);
+            }
+            if (binary) {
+                for_each_record(
+                    program,
+                    [](const gc_word_t* words, int n_words) { return Estimator::execute_words(words, n_words), true; },
+                    [](char* text) { return Estimator::execute_line(text), true; });
+            }
+        }
+        Estimator::end(console);
+        printf("Estimated in %.3f s\n", (Bench::now_ns() - start) / 1e9);
+    }
+
+    // Counts one line, which execute() runs.  Returns false when the job stops.
+    auto count_line = [](auto execute) {
+        ++Bench::stats.lines;
+        uint32_t lines_planned = mc_lines_planned;
+        if (execute() != Error::Ok) {
+            ++Bench::stats.errors;
+        }
+        if (gc_state.modal.motion == Motion::CwArc || gc_state.modal.motion == Motion::CcwArc) {
+            if (mc_lines_planned != lines_planned) {
+                ++Bench::stats.arcs;
+                Bench::stats.chords += mc_lines_planned - lines_planned;
+            }
+        }
+        return !(sys.abort || state_is(State::Alarm));
+    };
+
+    uint64_t start = Bench::now_ns();
+    for (int pass = 0; pass < repeat && !sys.abort; pass++) {
+        if (fileJob) {
+            try {
+                Job::nest(binary ? new BinaryInputFile("", gcodeFile) : new InputFile("", gcodeFile), &console);
+            } catch (Error err) {
+                fprintf(stderr, "Cannot open %s\n", gcodeFile);
+                return 1;
+            }
+            Error status;
+            while (Job::active() && (status = Job::channel()->pollLine(line)) == Error::Ok) {
+                int              n_words;
+                const gc_word_t* words = Job::channel()->preparsed(n_words);
+                if (!count_line([&] { return words ? gc_execute_words(words, n_words) : gc_execute_line(line); })) {
+                    break;
+                }
+            }
+            Job::abort();
+            continue;
+        }
+        if (binary) {
+            bool valid = for_each_record(
+                program,
+                [&](const gc_word_t* words, int n_words) { return count_line([&] { return gc_execute_words(words, n_words); }); },
+                [&](char* text) { return count_line([&] { return gc_execute_line(text); }); });
+            if (!valid) {
+                fprintf(stderr, "Bad record in %s\n", gcodeFile);
+                break;
+            }
+        }
+        for (auto const& text : lines) {
+            strncpy(line, text.c_str(), LINE_BUFFER_SIZE - 1);
+            line[LINE_BUFFER_SIZE - 1] = '\0';
+            if (!count_line([&] { return gc_execute_line(line); })) {
+                break;
+            }
+        }
+    }
+    protocol_buffer_synchronize();
+    uint64_t total_ns = Bench::now_ns() - start;
+    Bench::trace_close();
+
+    auto&    s       = Bench::stats;
+    uint64_t plan_ns = total_ns - s.prep_ns - s.isr_ns;
+    double   machine = double(s.sim_ticks) / Bench::timer_frequency();
+
+    printf("\n");
+    printf("Planner    %10u  blocks\n", (unsigned)plan_get_block_buffer_size());
+    printf("Lines      %10llu  %12.0f lines/s     (parse+plan %.3f s)\n", (unsigned long long)s.lines, per_sec(s.lines, plan_ns), plan_ns / 1e9);
+    printf("Blocks     %10llu  %12.0f blocks/s\n", (unsigned long long)s.blocks, per_sec(s.blocks, plan_ns));
+    if (s.arcs) {
+        printf("Arcs       %10llu  %12.0f arcs/s      (%.1f chords/arc)\n",
+               (unsigned long long)s.arcs,
+               per_sec(s.arcs, plan_ns),
+               double(s.chords) / s.arcs);
+    }
+    printf("Segments   %10llu  %12.0f segments/s  (prep_buffer %.3f s)\n", (unsigned long long)s.segments, per_sec(s.segments, s.prep_ns), s.prep_ns / 1e9);
+    // The segment buffer stays full as long as prep_buffer() can make a segment in much less
+    // time than the segment takes to execute
+    double seg_us = s.segments ? s.prep_ns / 1e3 / s.segments : 0.0;
+    double seg_ms = 1000.0 / ACCELERATION_TICKS_PER_SECOND;
+    printf("           %10.2f  us/segment         (%.3f%% of the %.0f ms segment time)\n", seg_us, seg_us / (seg_ms * 10.0), seg_ms);
+    printf("ISR calls  %10llu  %12.0f calls/s     (pulse_func %.3f s)\n", (unsigned long long)s.isr_calls, per_sec(s.isr_calls, s.isr_ns), s.isr_ns / 1e9);
+    if (Stepper::underruns) {
+        printf("Underruns  %10u  segment buffer ran dry mid-block\n", (unsigned)Stepper::underruns);
+    }
+    if (Stepping::_autoSegments) {
+        printf("Depth      %10u  segments of %u     (auto_segments)\n", (unsigned)Stepper::segment_depth(), (unsigned)Stepping::_segments);
+    }
+    if (s.steps) {
+        printf("Steps      %10llu  %12.1f ns/step     (pulse_func)\n", (unsigned long long)s.steps, double(s.isr_ns) / s.steps);
+    }
+    if (s.pairs) {
+        printf("Jitter     %10.2f%%  mean change between consecutive step intervals\n", 100.0 * s.jitter / s.pairs);
+    }
+    printf("Total %.3f s for %.3f s of motion (%.0fx real time)", total_ns / 1e9, machine, total_ns ? machine * 1e9 / total_ns : 0.0);
+    if (s.errors) {
+        printf(", %llu lines with errors", (unsigned long long)s.errors);
+    }
+    printf("\n");
+
+    return state_is(State::Alarm) ? 1 : 0;
+}
@@ -0,0 +1,47 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+#pragma once
+
+/*
+  Bench.h - shared state of the native motion pipeline benchmark
+*/
+
+#include <cstdint>
+
+namespace Bench {
+    // Work counts and CPU time per pipeline stage.  The parse+plan
+    // stage is not timed directly; it is whatever remains of the
+    // total once prep_buffer() and pulse_func() time is removed.
+    struct Stats {
+        uint64_t lines;      // G-code lines given to gc_execute_line()
+        uint64_t errors;     // Lines that returned an error
+        uint64_t arcs;       // Lines that ran an arc
+        uint64_t chords;     // Lines that mc_arc() gave to the planner for those arcs
+        uint64_t blocks;     // Planner blocks consumed by prep_buffer()
+        uint64_t segments;   // Step segments loaded by pulse_func()
+        uint64_t isr_calls;  // Calls to pulse_func()
+        uint64_t steps;      // Motor steps, counted only by the Capture engine
+        uint64_t pairs;      // Consecutive step intervals on the same pin, compared by the Capture engine
+        double   jitter;     // Sum over those pairs of the change in interval over the longer interval
+        uint64_t sim_ticks;  // Simulated step timer ticks
+        uint64_t prep_ns;    // Time spent in prep_buffer()
+        uint64_t isr_ns;     // Time spent in pulse_func()
+    };
+
+    extern Stats stats;
+
+    uint64_t now_ns();
+
+    // Refill the segment buffer, accounting for the planner blocks it consumes
+    void prep();
+
+    // Run the step timer ISR for up to ticks of simulated time, or until stepping stops
+    void run_isr(uint64_t ticks);
+
+    // Frequency of the simulated step timer
+    uint32_t timer_frequency();
+
+    // Destination of the Capture step engine's trace
+    bool trace_open(const char* filename);
+    void trace_close();
+}
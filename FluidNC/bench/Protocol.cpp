@@ -0,0 +1,217 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+/*
+  Protocol stand-in for the native bench build
+
+  src/Protocol.cpp is built around the FreeRTOS tasks, channels and
+  interrupts of the target.  This replacement keeps the parts of its
+  interface that the motion pipeline calls, but runs them in a single
+  deterministic thread: each pass through protocol_exec_rt_system()
+  refills the segment buffer and then runs the step ISR for half a
+  buffer's worth of simulated time, so the planner and segment buffers
+  stay as full as they would on a machine that keeps up.
+*/
+
+#include "src/Protocol.h"
+#include "src/Error.h"
+#include "src/Estimator.h"
+#include "src/Logging.h"
+#include "src/Planner.h"
+#include "src/Stepper.h"
+#include "src/Stepping.h"
+#include "src/StepperPrivate.h"  // DT_SEGMENT
+#include "src/System.h"
+#include "src/Machine/MachineConfig.h"
+#include "Bench.h"
+
+#include <deque>
+
+volatile ExecAlarm lastAlarm;
+
+volatile bool rtCycleStop;
+volatile bool runLimitLoop;
+
+bool pollingPaused = false;
+
+xQueueHandle event_queue;
+xQueueHandle message_queue;
+TaskHandle_t outputTask = nullptr;
+
+uint32_t heapLowWater = UINT_MAX;
+
+volatile const char* unwind_cause = nullptr;
+
+const std::map<ExecAlarm, const char*> AlarmNames = {
+    { ExecAlarm::None, "None" },
+    { ExecAlarm::HardLimit, "Hard Limit" },
+    { ExecAlarm::SoftLimit, "Soft Limit" },
+    { ExecAlarm::AbortCycle, "Abort Cycle" },
+    { ExecAlarm::ProbeFailInitial, "Probe Fail Initial" },
+    { ExecAlarm::ProbeFailContact, "Probe Fail Contact" },
+    { ExecAlarm::HomingFailReset, "Homing Fail Reset" },
+    { ExecAlarm::HomingFailDoor, "Homing Fail Door" },
+    { ExecAlarm::HomingFailPulloff, "Homing Fail Pulloff" },
+    { ExecAlarm::HomingFailApproach, "Homing Fail Approach" },
+    { ExecAlarm::SpindleControl, "Spindle Control" },
+    { ExecAlarm::ControlPin, "Control Pin Initially On" },
+    { ExecAlarm::HomingAmbiguousSwitch, "Ambiguous Switch" },
+    { ExecAlarm::HardStop, "Hard Stop" },
+    { ExecAlarm::Unhomed, "Unhomed" },
+    { ExecAlarm::Init, "Init" },
+    { ExecAlarm::ExpanderReset, "Expander Reset" },
+};
+
+const char* alarmString(ExecAlarm alarmNumber) {
+    auto it = AlarmNames.find(alarmNumber);
+    return it == AlarmNames.end() ? NULL : it->second;
+}
+
+const char* errorString(Error errorNumber) {
+    auto it = ErrorNames.find(errorNumber);
+    return it == ErrorNames.end() ? NULL : it->second;
+}
+
+namespace Bench {
+    Stats stats;
+
+    static uint32_t queued_blocks() {
+        return (plan_get_block_buffer_size() - 1) - plan_get_block_buffer_available();
+    }
+
+    void prep() {
+        uint32_t before = queued_blocks();
+        uint64_t start  = now_ns();
+        Stepper::prep_buffer();
+        stats.prep_ns += now_ns() - start;
+        stats.blocks += before - queued_blocks();
+    }
+}
+
+static void protocol_do_cycle_start() {
+    if (!state_is(State::Idle)) {
+        return;
+    }
+    plan_block_t* pb = plan_get_current_block();
+    if (pb) {
+        sys.step_control = {};
+        set_state(pb->is_jog ? State::Jog : State::Cycle);
+        Bench::prep();
+        Stepper::wake_up();
+    }
+}
+
+static void protocol_do_cycle_stop() {
+    if (state_is(State::Cycle) || state_is(State::Jog)) {
+        set_state(State::Idle);
+    }
+}
+
+// Events that the bench does not need to act on have no handler
+const ArgEvent feedOverrideEvent { nullptr };
+const ArgEvent rapidOverrideEvent { nullptr };
+const ArgEvent spindleOverrideEvent { nullptr };
+const ArgEvent accessoryOverrideEvent { nullptr };
+const ArgEvent limitEvent { nullptr };
+const ArgEvent faultPinEvent { nullptr };
+const ArgEvent reportStatusEvent { nullptr };
+const ArgEvent pinActiveEvent { nullptr };
+const ArgEvent pinInactiveEvent { nullptr };
+
+const NoArgEvent safetyDoorEvent { nullptr };
+const NoArgEvent feedHoldEvent { nullptr };
+const NoArgEvent cycleStartEvent { protocol_do_cycle_start };
+const NoArgEvent cycleStopEvent { protocol_do_cycle_stop };
+const NoArgEvent motionCancelEvent { nullptr };
+const NoArgEvent sleepEvent { nullptr };
+const NoArgEvent debugEvent { nullptr };
+const NoArgEvent startEvent { nullptr };
+const NoArgEvent restartEvent { nullptr };
+const NoArgEvent fullResetEvent { nullptr };
+const NoArgEvent rtResetEvent { nullptr };
+const NoArgEvent unhomedEvent { nullptr };
+const NoArgEvent runStartupLinesEvent { nullptr };
+const NoArgEvent homingButtonEvent { nullptr };
+
+// Events are handled in order from protocol_exec_rt_system(), as on the target
+static std::deque<EventItem> events;
+
+void protocol_send_event(const Event* evt, void* arg) {
+    events.push_back({ evt, arg });
+}
+
+void protocol_send_event_from_ISR(const Event* evt, void* arg) {
+    events.push_back({ evt, arg });
+}
+
+void protocol_handle_events() {
+    while (!events.empty()) {
+        EventItem item = events.front();
+        events.pop_front();
+        item.event->run(item.arg);
+    }
+}
+
+void send_alarm(ExecAlarm alarm) {
+    lastAlarm = alarm;
+    set_state(State::Alarm);
+    log_error("Alarm " << alarmString(alarm));
+}
+
+void send_alarm_from_ISR(ExecAlarm alarm) {
+    send_alarm(alarm);
+}
+
+void drain_messages() {}
+
+void protocol_reset() {
+    events.clear();
+}
+
+void protocol_exec_rt_system() {
+    protocol_handle_events();
+
+    switch (sys.state) {
+        case State::Cycle:
+        case State::Hold:
+        case State::SafetyDoor:
+        case State::Homing:
+        case State::Jog: {
+            Bench::prep();
+            // Consume about half of the segment buffer so that the next
+            // pass has room to refill it
+            float seconds = DT_SEGMENT * 60.0f * Stepping::_segments / 2;
+            Bench::run_isr(uint64_t(seconds * Bench::timer_frequency()));
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void protocol_execute_realtime() {
+    protocol_exec_rt_system();
+}
+
+void protocol_auto_cycle_start() {
+    if (plan_get_current_block() != NULL && !state_is(State::Cycle) && !state_is(State::Hold)) {
+        protocol_send_event(&cycleStartEvent);
+    }
+}
+
+void protocol_buffer_synchronize() {
+    if (Estimator::active) {
+        Estimator::flush();  // Simulated motion completes immediately
+        return;
+    }
+    do {
+        protocol_auto_cycle_start();
+        protocol_execute_realtime();
+        if (sys.abort || state_is(State::Alarm)) {
+            return;
+        }
+    } while (plan_get_current_block() || state_is(State::Cycle));
+}
+
+void protocol_disable_steppers() {}
+void protocol_cancel_disable_steppers() {}
+void protocol_do_motion_cancel() {}
@@ -0,0 +1,66 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+/*
+  Simulated step timer for the native bench build
+
+  On the target, the step timer fires an interrupt every period and the
+  interrupt calls Stepper::pulse_func().  Here, Bench::run_isr() plays
+  that role synchronously, advancing a simulated clock by the current
+  period for each call.  Every segment load reprograms the period, so
+  stepTimerSetTicks() doubles as the segment counter.
+*/
+
+#include "Driver/StepTimer.h"
+#include "Bench.h"
+
+#include <chrono>
+
+static bool (*timer_isr_callback)(void);
+static uint32_t timer_frequency;
+static uint32_t timer_ticks;
+static bool     timer_running;
+
+void stepTimerInit(uint32_t frequency, bool (*callback)(void)) {
+    timer_frequency    = frequency;
+    timer_isr_callback = callback;
+}
+
+void stepTimerSetTicks(uint32_t ticks) {
+    timer_ticks = ticks;
+    ++Bench::stats.segments;
+}
+
+void stepTimerStart() {
+    timer_running = true;
+}
+
+void stepTimerStop() {
+    timer_running = false;
+}
+
+namespace Bench {
+    uint64_t now_ns() {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint32_t timer_frequency() {
+        return ::timer_frequency;
+    }
+
+    void run_isr(uint64_t ticks) {
+        if (!timer_running) {
+            return;
+        }
+        uint64_t end_ticks = stats.sim_ticks + ticks;
+        uint64_t start     = now_ns();
+        while (timer_running && stats.sim_ticks < end_ticks) {
+            ++stats.isr_calls;
+            stats.sim_ticks += timer_ticks;
+            if (!timer_isr_callback()) {
+                timer_running = false;
+            }
+        }
+        stats.isr_ns += now_ns() - start;
+    }
+}
@@ -0,0 +1,205 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+/*
+  Stepping engine that records step, direction and timer events
+
+  Selected with "engine: Capture" or the bench -t option.  Instead of
+  driving GPIOs, every set_step_pin(), set_dir_pin() and set_timer_ticks()
+  call is appended to a binary trace, stamped with the simulated step
+  timer tick at which it happened.  Two runs that produce identical
+  traces moved the motors identically, so "cmp before.trace after.trace"
+  proves that a planner or stepper change did not alter the motion.
+
+  Trace format, all integers little-endian:
+    header:  "FNCSTEP" 0x01, uint32 step timer frequency
+    record:  varint ticks since the previous record, then a tag byte
+      tag 0x00|level  step pin change, followed by a pin byte
+      tag 0x02|level  direction pin change, followed by a pin byte
+      tag 0x04        new timer period, followed by a varint of ticks
+  A varint is 7 bits per byte, least significant first, with the high
+  bit set on all but the last byte.
+
+  The engine also measures step smoothness: how much each step interval
+  on a pin differs from the one before it.  Pauses between moves are not
+  counted.
+*/
+
+#include "Driver/step_engine.h"
+#include "Driver/StepTimer.h"
+#include "Bench.h"
+
+#include <cstdio>
+
+enum : uint8_t {
+    TAG_STEP  = 0x00,
+    TAG_DIR   = 0x02,
+    TAG_TICKS = 0x04,
+};
+
+static FILE*    trace_file;
+static uint64_t last_tick;
+static uint32_t _pulse_delay_us;
+static bool     in_step;  // Between start_step() and finish_step()
+
+static const int n_pins = 64;
+static uint64_t  last_step[n_pins];      // Tick of each pin's last step
+static uint64_t  last_interval[n_pins];  // Ticks between each pin's last two steps
+static uint64_t  max_interval;           // Longer intervals are pauses rather than steps
+
+static uint8_t trace_buf[1 << 16];
+static size_t  trace_len;
+
+static void flush_trace() {
+    if (trace_file && trace_len) {
+        fwrite(trace_buf, 1, trace_len, trace_file);
+    }
+    trace_len = 0;
+}
+
+static void put_byte(uint8_t b) {
+    trace_buf[trace_len++] = b;
+}
+
+static void put_varint(uint64_t v) {
+    while (v >= 0x80) {
+        put_byte(uint8_t(v) | 0x80);
+        v >>= 7;
+    }
+    put_byte(uint8_t(v));
+}
+
+static void put_u32(uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        put_byte(uint8_t(v >> (8 * i)));
+    }
+}
+
+// Start a record with the time since the previous one
+static void record(uint8_t tag) {
+    // The largest record is 10 bytes of delta, a tag and 5 bytes of ticks
+    if (trace_len > sizeof(trace_buf) - 16) {
+        flush_trace();
+    }
+    uint64_t now = Bench::stats.sim_ticks;
+    put_varint(now - last_tick);
+    put_byte(tag);
+    last_tick = now;
+}
+
+namespace Bench {
+    bool trace_open(const char* filename) {
+        trace_file = fopen(filename, "wb");
+        return trace_file != nullptr;
+    }
+
+    void trace_close() {
+        if (trace_file) {
+            flush_trace();
+            fclose(trace_file);
+            trace_file = nullptr;
+        }
+    }
+}
+
+static uint32_t init_engine(uint32_t dir_delay_us, uint32_t pulse_delay_us, uint32_t frequency, bool (*callback)(void)) {
+    stepTimerInit(frequency, callback);
+    _pulse_delay_us = pulse_delay_us;
+
+    for (const char* p = "FNCSTEP"; *p; ++p) {
+        put_byte(*p);
+    }
+    put_byte(1);  // Format version
+    put_u32(frequency);
+    last_tick    = Bench::stats.sim_ticks;
+    max_interval = frequency / 20;
+    return _pulse_delay_us;
+}
+
+static int init_step_pin(int step_pin, int step_invert) {
+    return step_pin;
+}
+
+static void set_dir_pin(int pin, int level) {
+    record(TAG_DIR | (level & 1));
+    put_byte(pin);
+}
+
+static void measure_interval(int pin) {
+    uint64_t now      = Bench::stats.sim_ticks;
+    uint64_t interval = last_step[pin] ? now - last_step[pin] : 0;
+    uint64_t previous = last_interval[pin];
+    if (interval && previous && interval <= max_interval && previous <= max_interval) {
+        uint64_t longer = interval > previous ? interval : previous;
+        uint64_t change = interval > previous ? interval - previous : previous - interval;
+        ++Bench::stats.pairs;
+        Bench::stats.jitter += double(change) / longer;
+    }
+    last_step[pin]     = now;
+    last_interval[pin] = interval;
+}
+
+static void set_step_pin(int pin, int level) {
+    record(TAG_STEP | (level & 1));
+    put_byte(pin);
+    if (in_step) {
+        ++Bench::stats.steps;
+        if (pin < n_pins) {
+            measure_interval(pin);
+        }
+    }
+}
+
+static void finish_dir() {}
+
+static void start_step() {
+    in_step = true;
+}
+
+static void finish_step() {
+    in_step = false;
+}
+
+static int  start_unstep() {
+    return 0;
+}
+static void finish_unstep() {}
+
+static uint32_t max_pulses_per_sec() {
+    // pulse_us can be 0, but a pulse still takes some time
+    uint32_t pulse_us = _pulse_delay_us ? _pulse_delay_us : 1;
+    return 1000000 / (2 * pulse_us);
+}
+
+static void set_timer_ticks(uint32_t ticks) {
+    record(TAG_TICKS);
+    put_varint(ticks);
+    stepTimerSetTicks(ticks);
+}
+
+static void start_timer() {
+    stepTimerStart();
+}
+
+static void stop_timer() {
+    stepTimerStop();
+}
+
+// clang-format off
+static step_engine_t engine = {
+    "Capture",
+    init_engine,
+    init_step_pin,
+    set_dir_pin,
+    finish_dir,
+    start_step,
+    set_step_pin,
+    finish_step,
+    start_unstep,
+    finish_unstep,
+    max_pulses_per_sec,
+    set_timer_ticks,
+    start_timer,
+    stop_timer
+};
+
+REGISTER_STEP_ENGINE(Capture, &engine);
@@ -0,0 +1,170 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+/*
+  Host stand-ins for the FluidNC/esp32 drivers.
+
+  The native bench build links the real motion pipeline, which reaches
+  the hardware only through the interfaces in include/Driver.  These
+  implementations keep just enough state for the pipeline to run on a
+  PC: GPIO levels are remembered so that pins read back what was
+  written, UARTs, buses and filesystems are inert, and the busy-wait
+  delays return immediately so that step timing is governed only by the
+  simulated step timer.
+*/
+
+#include "src/Pins/PinDetail.h"  // pinnum_t
+#include "Driver/fluidnc_gpio.h"
+#include "Driver/fluidnc_uart.h"
+#include "Driver/fluidnc_i2c.h"
+#include "Driver/delay_usecs.h"
+#include "Driver/PwmPin.h"
+#include "Driver/i2s_out.h"
+#include "Driver/sdspi.h"
+#include "Driver/spi.h"
+#include "Driver/restart.h"
+#include "Driver/localfs.h"
+#include "Driver/extmem.h"
+
+#include <cstdlib>
+
+// GPIO
+
+static const int n_gpios = 64;
+static int       gpio_levels[n_gpios];
+
+void gpio_write(pinnum_t pin, int value) {
+    if (pin < n_gpios) {
+        gpio_levels[pin] = value;
+    }
+}
+void gpio_write_masks(uint64_t set_mask, uint64_t clear_mask) {
+    for (; clear_mask; clear_mask &= clear_mask - 1) {
+        gpio_levels[__builtin_ctzll(clear_mask)] = 0;
+    }
+    for (; set_mask; set_mask &= set_mask - 1) {
+        gpio_levels[__builtin_ctzll(set_mask)] = 1;
+    }
+}
+int gpio_read(pinnum_t pin) {
+    return pin < n_gpios ? gpio_levels[pin] : 0;
+}
+void gpio_mode(pinnum_t pin, int input, int output, int pullup, int pulldown, int opendrain) {
+    if (pin < n_gpios && pullup) {
+        gpio_levels[pin] = 1;
+    }
+}
+void gpio_set_interrupt_type(pinnum_t pin, int mode) {}
+void gpio_add_interrupt(pinnum_t pin, int mode, void (*callback)(void*), void* arg) {}
+void gpio_remove_interrupt(pinnum_t pin) {}
+void gpio_route(pinnum_t pin, uint32_t signal) {}
+
+void gpio_set_event(int gpio_num, void* arg, int invert) {}
+void gpio_clear_event(int gpio_num) {}
+void poll_gpios() {}
+
+// UART
+
+void uart_init(int uart_num) {}
+void uart_mode(int uart_num, unsigned long baud, UartData dataBits, UartParity parity, UartStop stopBits) {}
+bool uart_half_duplex(int uart_num) {
+    return false;
+}
+int uart_read(int uart_num, uint8_t* buf, int len, int timeout_ms) {
+    return 0;
+}
+int uart_write(int uart_num, const uint8_t* buf, int len) {
+    return len;
+}
+void uart_xon(int uart_num) {}
+void uart_xoff(int uart_num) {}
+void uart_sw_flow_control(int uart_num, bool on, int xon_threshold, int xoff_threshold) {}
+bool uart_pins(int uart_num, int tx_pin, int rx_pin, int rts_pin, int cts_pin) {
+    return false;
+}
+int uart_buflen(int uart_num) {
+    return 0;
+}
+void uart_discard_input(int uart_num) {}
+bool uart_wait_output(int uart_num, int timeout_ms) {
+    return false;
+}
+void uart_register_input_pin(int uart_num, uint8_t pinnum, InputPin* object) {}
+
+// I2C, SPI, I2S and SD card
+
+bool i2c_master_init(int bus_number, pinnum_t sda_pin, pinnum_t scl_pin, uint32_t frequency) {
+    return true;
+}
+int i2c_write(int bus_number, uint8_t address, const uint8_t* data, size_t count) {
+    return -1;
+}
+int i2c_read(int bus_number, uint8_t address, uint8_t* data, size_t count) {
+    return -1;
+}
+
+bool spi_init_bus(pinnum_t sck_pin, pinnum_t miso_pin, pinnum_t mosi_pin, bool dma) {
+    return false;
+}
+void spi_deinit_bus() {}
+
+int i2s_out_init(i2s_out_init_t* init_param) {
+    return -1;
+}
+
+bool sd_init_slot(uint32_t freq_hz, int cs_pin, int cd_pin, int wp_pin) {
+    return false;
+}
+void sd_unmount() {}
+void sd_deinit_slot() {}
+
+std::error_code sd_mount(int max_files) {
+    return std::make_error_code(std::errc::no_such_device);
+}
+
+// Host paths are used as-is
+const char* canonicalPath(const char* filename, const char* defaultFs) {
+    return filename;
+}
+
+// The host's RAM stands in for PSRAM, so that long planner buffers can be measured
+
+void* extmem_calloc(size_t count, size_t size, bool* external) {
+    *external = true;
+    return calloc(count, size);
+}
+void extmem_free(void* ptr) {
+    free(ptr);
+}
+
+// PWM
+
+PwmPin::PwmPin(int gpio, bool invert, uint32_t frequency) : _gpio(gpio), _frequency(frequency), _channel(0), _period(1 << 10) {}
+PwmPin::~PwmPin() {}
+void PwmPin::setDuty(uint32_t duty) {}
+
+// Timing
+
+uint32_t ticks_per_us = 240;
+
+void timing_init() {}
+void spinUntil(int32_t endTicks) {}
+void delay_us(int32_t us) {}
+
+int32_t usToCpuTicks(int32_t us) {
+    return us * ticks_per_us;
+}
+int32_t usToEndTicks(int32_t us) {
+    return getCpuTicks() + usToCpuTicks(us);
+}
+int32_t getCpuTicks() {
+    return 0;
+}
+
+// Restart
+
+bool restart_was_panic() {
+    return false;
+}
+void restart() {
+    exit(1);
+}
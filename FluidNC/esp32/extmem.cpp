@@ -0,0 +1,15 @@
+#include "Driver/extmem.h"
+#include "esp_heap_caps.h"
+
+void* extmem_calloc(size_t count, size_t size, bool* external) {
+    void* ptr = heap_caps_calloc(count, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    *external = ptr != nullptr;
+    if (!ptr) {
+        ptr = heap_caps_calloc(count, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    return ptr;
+}
+
+void extmem_free(void* ptr) {
+    heap_caps_free(ptr);
+}
@@ -14,6 +14,23 @@ static gpio_dev_t* _gpio_dev = GPIO_HAL_GET_HW(GPIO_PORT_0);
 void IRAM_ATTR gpio_write(pinnum_t pin, int value) {
     gpio_ll_set_level(_gpio_dev, (gpio_num_t)pin, (uint32_t)value);
 }
+void IRAM_ATTR gpio_write_masks(uint64_t set_mask, uint64_t clear_mask) {
+    // GPIOs 0-31 and 32-39 are in separate registers
+    uint32_t set_low = set_mask, clear_low = clear_mask;
+    uint32_t set_high = set_mask >> 32, clear_high = clear_mask >> 32;
+    if (clear_low) {
+        _gpio_dev->out_w1tc = clear_low;
+    }
+    if (set_low) {
+        _gpio_dev->out_w1ts = set_low;
+    }
+    if (clear_high) {
+        _gpio_dev->out1_w1tc.val = clear_high;
+    }
+    if (set_high) {
+        _gpio_dev->out1_w1ts.val = set_high;
+    }
+}
 int IRAM_ATTR gpio_read(pinnum_t pin) {
     return gpio_ll_get_level(_gpio_dev, (gpio_num_t)pin);
 }
@@ -9,6 +9,11 @@
 // pulse_func to determine the new values of those variables. The FIFO lets the ISR stay
 // just far enough ahead so the information is always ready, but not so far ahead to cause
 // latency problems.
+//
+// The I2S_STREAM engine below uses the same pulse and delay variables, but a task instead
+// of the ISR expands them into DMA buffers that hold several milliseconds of samples.  The
+// delays between step events become block fills, and the only interrupt is the DMA's
+// end-of-buffer, once per buffer instead of once per FIFO_RELOAD samples.
 
 #include "Driver/step_engine.h"
 #include "Driver/i2s_out.h"
@@ -22,6 +27,9 @@
 #include <esp_attr.h>  // IRAM_ATTR
 
 #include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <esp_heap_caps.h>
 
 #include <driver/periph_ctrl.h>
 #include <rom/lldesc.h>
@@ -154,10 +162,19 @@ static int i2s_out_start() {
 
 static bool timer_running = false;
 
+// The stream engine keeps DMA_BUF_COUNT buffers of DMA_BUF_SAMPLES samples queued.
+// Pin changes take effect after the queued samples have been sent, so the buffers
+// trade output latency against the time the fill task may be held off.  A DMA
+// descriptor can hold at most 4092 bytes.
+#define DMA_BUF_COUNT 5
+#define DMA_BUF_SAMPLES 1000
+
+static bool streaming = false;
+
 void i2s_out_delay() {
     // Depending on the timing, it may not be reflected immediately,
     // so wait twice as long just in case.
-    uint32_t wait_counts = timer_running ? FIFO_THRESHOLD + FIFO_RELOAD : 2;
+    uint32_t wait_counts = streaming ? (DMA_BUF_COUNT + 1) * DMA_BUF_SAMPLES : timer_running ? FIFO_THRESHOLD + FIFO_RELOAD : 2;
     delay_us(i2s_frame_us * wait_counts);
 }
 
@@ -169,7 +186,7 @@ void IRAM_ATTR i2s_out_write(pinnum_t pin, uint8_t val) {
         i2s_out_port_data &= ~bit;
     }
 
-    if (!timer_running) {
+    if (!timer_running && !streaming) {
         // Direct write to the I2S FIFO in case the pulse timer is not running
         I2S0.fifo_wr = i2s_out_port_data;
     }
@@ -391,10 +408,8 @@ static void i2s_fifo_intr_setup() {
                               NULL);
 }
 
-static uint32_t init_engine(uint32_t dir_delay_us, uint32_t pulse_us, uint32_t frequency, bool (*callback)(void)) {
-    _pulse_func = callback;
-    i2s_fifo_intr_setup();
-
+// Converts the pulse timing to counts of I2S frames, shared by both engines
+static void set_pulse_timing(uint32_t dir_delay_us, uint32_t pulse_us, uint32_t frequency) {
     if (pulse_us < i2s_frame_us) {
         pulse_us = i2s_frame_us;
     }
@@ -407,6 +422,13 @@ static uint32_t init_engine(uint32_t dir_delay_us, uint32_t pulse_us, uint32_t f
 
     _remaining_pulse_counts = 0;
     _remaining_delay_counts = 0;
+}
+
+static uint32_t init_engine(uint32_t dir_delay_us, uint32_t pulse_us, uint32_t frequency, bool (*callback)(void)) {
+    _pulse_func = callback;
+    i2s_fifo_intr_setup();
+
+    set_pulse_timing(dir_delay_us, pulse_us, frequency);
 
     // gpio_mode(12, 0, 1, 0, 0, 0);
 
@@ -483,3 +505,205 @@ step_engine_t i2s_engine = {
 };
 // clang-format on
 REGISTER_STEP_ENGINE(I2S, &i2s_engine);
+
+// Streaming engine
+
+static lldesc_t*     _dma_desc[DMA_BUF_COUNT];
+static QueueHandle_t _dma_done_queue;  // Descriptors that the DMA has finished sending
+static TaskHandle_t  _stream_task;
+static intr_handle_t _dma_intr;
+
+static uint32_t _dir_delay_counts;
+static uint32_t _remaining_dir_counts = 0;
+static uint32_t _pending_dir_counts   = 0;  // Set by finish_dir(), for the next step event
+
+static inline IRAM_ATTR uint32_t* fill_samples(uint32_t* buf, uint32_t* end, uint32_t data, uint32_t* counts) {
+    uint32_t n = end - buf;
+    if (n > *counts) {
+        n = *counts;
+    }
+    *counts -= n;
+    while (n--) {
+        *buf++ = data;
+    }
+    return buf;
+}
+
+// Expands step events into one DMA buffer.  This runs in the stream task, not in an
+// ISR, so pulse_func() has the whole buffer time to prepare each batch of events.
+static void IRAM_ATTR fill_dma_buffer(uint32_t* buf) {
+    uint32_t* end     = buf + DMA_BUF_SAMPLES;
+    bool      stopped = false;
+    while (buf < end) {
+        if (_remaining_dir_counts) {
+            buf = fill_samples(buf, end, i2s_out_port_data, &_remaining_dir_counts);
+        } else if (_remaining_pulse_counts) {
+            buf = fill_samples(buf, end, _pulse_data, &_remaining_pulse_counts);
+        } else if (_remaining_delay_counts) {
+            buf = fill_samples(buf, end, i2s_out_port_data, &_remaining_delay_counts);
+        } else if (stopped) {
+            // Not stepping, so idle until the next buffer
+            uint32_t idle = end - buf;
+            buf           = fill_samples(buf, end, i2s_out_port_data, &idle);
+        } else {
+            _pulse_data = i2s_out_port_data;
+            // The last call of a motion still emits its pulse
+            stopped                 = !_pulse_func();
+            _remaining_dir_counts   = _pending_dir_counts;
+            _pending_dir_counts     = 0;
+            _remaining_pulse_counts = _pulse_data == i2s_out_port_data ? 0 : _pulse_counts;
+            uint32_t used           = _remaining_dir_counts + _remaining_pulse_counts;
+            _remaining_delay_counts = stopped ? 0 : _delay_counts > used ? _delay_counts - used : 0;
+        }
+    }
+}
+
+static void stream_task(void* arg) {
+    lldesc_t* desc;
+    while (true) {
+        if (xQueueReceive(_dma_done_queue, &desc, portMAX_DELAY)) {
+            fill_dma_buffer((uint32_t*)desc->buf);
+        }
+    }
+}
+
+static void IRAM_ATTR dma_isr(void* arg) {
+    BaseType_t woken  = pdFALSE;
+    uint32_t   status = i2s_ll_get_intr_status(&I2S0);
+    if (status & I2S_OUT_EOF_INT_ST) {
+        uint32_t desc;
+        i2s_ll_tx_get_eof_des_addr(&I2S0, &desc);
+        xQueueSendFromISR(_dma_done_queue, &desc, &woken);
+    }
+    i2s_ll_clear_intr_status(&I2S0, status);
+    if (woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+// Releases whatever init_stream_engine() managed to allocate
+static void free_stream_engine() {
+    if (_dma_intr) {
+        esp_intr_free(_dma_intr);
+        _dma_intr = NULL;
+    }
+    if (_stream_task) {
+        vTaskDelete(_stream_task);
+        _stream_task = NULL;
+    }
+    if (_dma_done_queue) {
+        vQueueDelete(_dma_done_queue);
+        _dma_done_queue = NULL;
+    }
+    for (int i = 0; i < DMA_BUF_COUNT; i++) {
+        if (_dma_desc[i]) {
+            heap_caps_free((void*)_dma_desc[i]->buf);
+            heap_caps_free(_dma_desc[i]);
+            _dma_desc[i] = NULL;
+        }
+    }
+}
+
+static uint32_t init_stream_engine(uint32_t dir_delay_us, uint32_t pulse_us, uint32_t frequency, bool (*callback)(void)) {
+    _pulse_func = callback;
+    set_pulse_timing(dir_delay_us, pulse_us, frequency);
+    _dir_delay_counts = (dir_delay_us + i2s_frame_us - 1) / i2s_frame_us;
+
+    // A ring of descriptors, each of which interrupts when it has been sent
+    for (int i = 0; i < DMA_BUF_COUNT; i++) {
+        _dma_desc[i] = heap_caps_calloc(1, sizeof(lldesc_t), MALLOC_CAP_DMA);
+        if (!_dma_desc[i]) {
+            free_stream_engine();
+            return STEP_ENGINE_INIT_FAILED;
+        }
+        uint32_t* buf = heap_caps_calloc(DMA_BUF_SAMPLES, sizeof(uint32_t), MALLOC_CAP_DMA);
+        if (!buf) {
+            free_stream_engine();
+            return STEP_ENGINE_INIT_FAILED;
+        }
+        uint32_t idle = DMA_BUF_SAMPLES;
+        fill_samples(buf, buf + DMA_BUF_SAMPLES, i2s_out_port_data, &idle);
+        _dma_desc[i]->buf    = (uint8_t*)buf;
+        _dma_desc[i]->size   = DMA_BUF_SAMPLES * sizeof(uint32_t);
+        _dma_desc[i]->length = DMA_BUF_SAMPLES * sizeof(uint32_t);
+        _dma_desc[i]->owner  = 1;
+        _dma_desc[i]->eof    = 1;
+    }
+    for (int i = 0; i < DMA_BUF_COUNT; i++) {
+        _dma_desc[i]->qe.stqe_next = _dma_desc[(i + 1) % DMA_BUF_COUNT];
+    }
+
+    // The task runs on the core that owns the stepping data, above the
+    // main loop's priority, so it preempts prep_buffer() as an ISR would.
+    _dma_done_queue = xQueueCreate(DMA_BUF_COUNT, sizeof(lldesc_t*));
+    if (!_dma_done_queue) {
+        free_stream_engine();
+        return STEP_ENGINE_INIT_FAILED;
+    }
+    BaseType_t created = xTaskCreatePinnedToCore(stream_task,               // task
+                                                 "i2s_stream",              // name for task
+                                                 4096,                      // size of task stack
+                                                 NULL,                      // parameters
+                                                 configMAX_PRIORITIES - 1,  // priority
+                                                 &_stream_task,             // task handle
+                                                 xPortGetCoreID()           // core
+    );
+    if (created != pdPASS) {
+        _stream_task = NULL;
+        free_stream_engine();
+        return STEP_ENGINE_INIT_FAILED;
+    }
+
+    // Allocated before the switch to DMA, so a failure leaves the FIFO output as it was
+    if (esp_intr_alloc(ETS_I2S0_INTR_SOURCE, ESP_INTR_FLAG_IRAM, dma_isr, NULL, &_dma_intr) != ESP_OK) {
+        _dma_intr = NULL;
+        free_stream_engine();
+        return STEP_ENGINE_INIT_FAILED;
+    }
+
+    // Switch the I2S output from CPU writes to the FIFO to DMA
+    i2s_ll_tx_stop(&I2S0);
+    i2s_out_reset_tx_rx();
+    i2s_out_reset_fifo_without_lock();
+    i2s_ll_tx_reset_dma(&I2S0);
+    i2s_ll_enable_dma(&I2S0, true);
+
+    i2s_ll_clear_intr_status(&I2S0, 0xffffffff);
+    i2s_ll_enable_intr(&I2S0, I2S_OUT_EOF_INT_ENA, 1);
+
+    streaming = true;
+    i2s_ll_tx_start_link(&I2S0, (uint32_t)_dma_desc[0]);
+    i2s_ll_tx_start(&I2S0);
+
+    return _pulse_counts * i2s_frame_us;
+}
+
+// The new direction bits are already in i2s_out_port_data.  Instead of
+// waiting, hold them for the direction delay ahead of the next pulse.
+static IRAM_ATTR void finish_stream_dir() {
+    _pending_dir_counts = _dir_delay_counts;
+}
+
+// The stream runs all the time; a step event with no pulse just idles
+static void IRAM_ATTR start_stream_timer() {}
+static void IRAM_ATTR stop_stream_timer() {}
+
+// clang-format off
+step_engine_t i2s_stream_engine = {
+    "I2S_STREAM",
+    init_stream_engine,
+    init_step_pin,
+    set_dir_pin,
+    finish_stream_dir,
+    start_step,
+    set_step_pin,
+    finish_step,
+    start_unstep,
+    finish_unstep,
+    max_pulses_per_sec,
+    set_timer_ticks,
+    start_stream_timer,
+    stop_stream_timer
+};
+// clang-format on
+REGISTER_STEP_ENGINE(I2S_STREAM, &i2s_stream_engine);
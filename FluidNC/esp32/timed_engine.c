@@ -2,6 +2,10 @@
 // Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
 
 // Stepping engine that uses direct GPIO accesses timed by spin loops.
+// The pin changes of each phase are collected into set and clear masks
+// and written together, so all the step pins of a step event - including
+// ganged motors - change at the same instant, in at most two register
+// writes per GPIO bank.
 
 #include "Driver/step_engine.h"
 #include "Driver/fluidnc_gpio.h"
@@ -26,11 +30,28 @@ static int init_step_pin(int step_pin, int step_invert) {
 
 static int _stepPulseEndTime;
 
+// Pin changes that have not been written yet
+static uint64_t _set_mask;
+static uint64_t _clear_mask;
+
 static void IRAM_ATTR set_pin(int pin, int level) {
-    gpio_write(pin, level);
+    if (level) {
+        _set_mask |= 1ULL << pin;
+    } else {
+        _clear_mask |= 1ULL << pin;
+    }
+}
+
+static void IRAM_ATTR commit_pins() {
+    if (_set_mask | _clear_mask) {
+        gpio_write_masks(_set_mask, _clear_mask);
+        _set_mask   = 0;
+        _clear_mask = 0;
+    }
 }
 
 static void IRAM_ATTR finish_dir() {
+    commit_pins();
     delay_us(_dir_delay_us);
 }
 
@@ -41,6 +62,7 @@ static void IRAM_ATTR start_step() {}
 // some work that is overlapped with the pulse time.  The spin loop
 // will happen in start_unstep()
 static void IRAM_ATTR finish_step() {
+    commit_pins();
     _stepPulseEndTime = usToEndTicks(_pulse_delay_us);
 }
 
@@ -49,9 +71,9 @@ static int IRAM_ATTR start_unstep() {
     return 0;
 }
 
-// This is a noop because each gpio_write() takes effect immediately,
-// so there is no need to commit multiple GPIO changes.
-static void IRAM_ATTR finish_unstep() {}
+static void IRAM_ATTR finish_unstep() {
+    commit_pins();
+}
 
 static uint32_t max_pulses_per_sec() {
     return 1000000 / (2 * _pulse_delay_us);
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stddef.h>
+
+// Allocate zeroed memory, preferably in external PSRAM.  Falls back to
+// internal RAM if there is no PSRAM or it is full.  Returns NULL if
+// neither has room.  The second argument reports where it went.
+void* extmem_calloc(size_t count, size_t size, bool* external);
+void  extmem_free(void* ptr);
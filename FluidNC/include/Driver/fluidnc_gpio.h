@@ -16,6 +16,9 @@ typedef uint8_t pinnum_t;
 // GPIO interface
 
 void gpio_write(pinnum_t pin, int value);
+// Drives the GPIOs whose bits are set in set_mask high and those in clear_mask low,
+// all at once.  Bit n of each mask is GPIO n.
+void gpio_write_masks(uint64_t set_mask, uint64_t clear_mask);
 int  gpio_read(pinnum_t pin);
 void gpio_mode(pinnum_t pin, int input, int output, int pullup, int pulldown, int opendrain);
 void gpio_set_interrupt_type(pinnum_t pin, int mode);
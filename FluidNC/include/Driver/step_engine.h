@@ -11,12 +11,15 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#define STEP_ENGINE_INIT_FAILED UINT32_MAX
+
 typedef struct step_engine {
     const char* name;
 
     // Prepare the engine for use
     // The return value is the actual pulse delay according to the
-    // characteristics of the engine.
+    // characteristics of the engine, or STEP_ENGINE_INIT_FAILED if the
+    // engine could not get the resources it needs.
     uint32_t (*init)(uint32_t dir_delay_us, uint32_t pulse_delay_us, uint32_t frequency, bool (*fn)(void));
 
     // Setup the step pin, returning a number to identify it.
@@ -0,0 +1,69 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+#include "BinaryInputFile.h"
+
+#include <cstring>
+
+BinaryInputFile::BinaryInputFile(const char* defaultFs, const char* path) : InputFile(defaultFs, path) {
+    char signature[GCodeBinary::signature_size];
+    if (FileStream::read(signature, sizeof(signature)) != sizeof(signature) ||
+        memcmp(signature, GCodeBinary::signature, sizeof(signature))) {
+        log_error(path << " is not a precompiled G-code file");
+        throw Error::FsFailedRead;
+    }
+}
+
+// Makes sure that the buffer holds a whole record, unless the file ends first
+void BinaryInputFile::fill() {
+    if (_tail - _head >= GCodeBinary::max_record) {
+        return;
+    }
+    memmove(_buffer, _buffer + _head, _tail - _head);
+    _tail -= _head;
+    _head = 0;
+    _tail += FileStream::read(reinterpret_cast<char*>(_buffer) + _tail, sizeof(_buffer) - _tail);
+}
+
+Error BinaryInputFile::nextLine(char* line) {
+    fill();
+    if (_head == _tail) {
+        line[0] = '\0';
+        return Error::Eof;
+    }
+    const uint8_t* p = _buffer + _head;
+    size_t         blank_lines;
+    if (!GCodeBinary::decode(p, _buffer + _tail, blank_lines, _words, _n_words, line)) {
+        log_error("Bad record in " << name() << " after line " << lineNumber());
+        return Error::FsFailedRead;
+    }
+    _head = p - _buffer;
+    _blank_lines += blank_lines;
+    _line_number += blank_lines + 1;
+    if (_n_words >= 0) {
+        line[0] = '\0';
+    }
+    return Error::Ok;
+}
+
+Error BinaryInputFile::readLine(char* line, int len) {
+    Error err = nextLine(line);
+    if (err == Error::Ok && _n_words >= 0) {
+        GCodeBinary::format(_words, _n_words, line, len);
+    }
+    return err;
+}
+
+size_t BinaryInputFile::file_position() {
+    return FileStream::position() - (_tail - _head);
+}
+
+void BinaryInputFile::file_seek(size_t pos) {
+    _head = _tail = 0;
+    FileStream::set_position(pos);
+}
+
+void BinaryInputFile::save() {
+    // FileStream::save() records position(), so the buffered bytes will be read again
+    InputFile::save();
+    _head = _tail = 0;
+}
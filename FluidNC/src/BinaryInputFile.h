@@ -0,0 +1,35 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+// BinaryInputFile runs a precompiled .gcb job file.  For each block, pollLine()
+// returns an empty line and preparsed() returns the words, which go straight to
+// gc_execute_words().  Lines that were kept as text are returned as usual.
+// readLine() shows blocks as text, for $SD/Show and the like.
+// See GCodeBinary.h for the file format.
+
+#pragma once
+
+#include "InputFile.h"
+#include "GCodeBinary.h"
+
+class BinaryInputFile : public InputFile {
+    // Room to decode any record without another read
+    uint8_t _buffer[2 * GCodeBinary::max_record];
+    size_t  _head = 0;  // Next byte to decode
+    size_t  _tail = 0;  // End of the bytes read from the file
+
+    void fill();
+
+protected:
+    Error nextLine(char* line) override;
+
+    // The file position of the next record, which excludes the buffered bytes
+    size_t file_position() override;
+    void   file_seek(size_t pos) override;
+
+public:
+    BinaryInputFile(const char* fsname, const char* path);
+
+    Error readLine(char* line, int len) override;
+
+    void save() override;
+};
@@ -201,6 +201,15 @@ public:
     virtual size_t position() { return 0; }
     virtual void   set_position(size_t pos) {}
 
+    // Flow control brackets each loop it runs with these, so that a channel can keep the
+    // lines of the loop for the next iteration
+    virtual void start_loop() {}
+    virtual void end_loop() {}
+
+    // Channels that read precompiled files or replay loops return the words of the block that
+    // pollLine() just returned as an empty line, or nullptr when the line has text to execute.
+    virtual const gc_word_t* preparsed(int& n_words) { return nullptr; }
+
     void pause();
     void resume();
 };
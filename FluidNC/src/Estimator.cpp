@@ -0,0 +1,176 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+#include "Estimator.h"
+
+#include "Channel.h"
+#include "GCode.h"       // gc_execute_line(), gc_state
+#include "Job.h"         // Job::nest()
+#include "Logging.h"     // log_info_to()
+#include "Parameters.h"  // float_params, global_named_params
+#include "Planner.h"     // plan_get_current_block()
+#include "Protocol.h"    // pollingPaused, protocol_exec_rt_system()
+#include "Serial.h"      // pollChannels()
+#include "Settings.h"    // coords
+#include "Stepper.h"     // Stepper::prep_buffer(), Stepper::discard_segments()
+#include "System.h"      // sys, set_state()
+#include "Machine/MachineConfig.h"
+
+#include <cctype>
+#include <cstring>
+#include <map>
+
+namespace Estimator {
+    bool active = false;
+
+    static uint64_t                    motion_ticks;  // Step timer ticks of the motion so far
+    static uint64_t                    dwell_ms;      // Time spent in dwells
+    static float                       peak_speed;    // Fastest speed reached (mm/min)
+    static uint32_t                    lines;         // Lines of G-code executed
+    static std::map<int32_t, uint64_t> tool_ticks;    // Motion time per tool
+
+    // Machine state that the job changes, put back by restore()
+    static parser_state_t                        saved_gc_state;
+    static system_t                              saved_sys;  // Overrides and spindle speed
+    static float                                 saved_coords[CoordIndex::End][MAX_N_AXIS];  // G10, G28.1, G30.1
+    static std::map<const ngc_param_id_t, float> saved_float_params;
+    static std::map<std::string, float>          saved_named_params;
+
+    void begin() {
+        saved_gc_state = gc_state;
+        saved_sys      = sys;
+        for (int i = CoordIndex::Begin; i < CoordIndex::End; ++i) {
+            coords[i]->get(saved_coords[i]);
+        }
+        saved_float_params = float_params;
+        saved_named_params = global_named_params;
+        motion_ticks   = 0;
+        dwell_ms       = 0;
+        peak_speed     = 0;
+        lines          = 0;
+        tool_ticks.clear();
+        set_state(State::CheckMode);
+        active = true;
+    }
+
+    Error execute_line(char* line) {
+        while (isspace(*line)) {
+            ++line;
+        }
+        // Settings and commands do not run during an estimate
+        if (line[0] == '$' || line[0] == '[') {
+            return Error::Ok;
+        }
+        ++lines;
+        return gc_execute_line(line);
+    }
+
+    Error execute_words(const gc_word_t* words, int n_words) {
+        ++lines;
+        return gc_execute_words(words, n_words);
+    }
+
+    bool advance() {
+        Stepper::prep_buffer();
+        uint64_t ticks = Stepper::discard_segments(peak_speed);
+        motion_ticks += ticks;
+        // Tool changes synchronize the buffer, so all of this motion was made with the current tool
+        tool_ticks[gc_state.current_tool] += ticks;
+        return ticks != 0;
+    }
+
+    void flush() {
+        while (plan_get_current_block() && advance()) {}
+    }
+
+    void dwell(int32_t milliseconds) {
+        dwell_ms += milliseconds;
+    }
+
+    static float seconds(uint64_t ticks) {
+        return float(ticks) / Machine::Stepping::fStepperTimer;
+    }
+
+    static void report(Channel& out) {
+        float total = seconds(motion_ticks) + dwell_ms / 1000.0f;
+        log_info_to(out, "Estimate: " << lines << " lines " << setprecision(1) << total << " s");
+        log_info_to(out, "Motion: " << setprecision(1) << seconds(motion_ticks) << " s Dwell: " << setprecision(1) << dwell_ms / 1000.0f << " s");
+        for (auto const& [tool, ticks] : tool_ticks) {
+            if (ticks) {
+                log_info_to(out, "Tool " << tool << ": " << setprecision(1) << seconds(ticks) << " s");
+            }
+        }
+        log_info_to(out, "Max feed: " << setprecision(0) << peak_speed << " mm/min");
+    }
+
+    // Puts the parser and planner back where the job started, as if it had not run
+    static void restore() {
+        gc_state = saved_gc_state;
+        for (int i = CoordIndex::Begin; i < CoordIndex::End; ++i) {
+            // Only the changed ones are written back, to spare the flash
+            if (memcmp(coords[i]->get(), saved_coords[i], sizeof(saved_coords[i]))) {
+                coords[i]->set(saved_coords[i]);
+                gc_ngc_changed(CoordIndex(i));
+            }
+        }
+        gc_wco_changed();
+        float_params          = saved_float_params;
+        global_named_params   = saved_named_params;
+        sys.f_override        = saved_sys.f_override;
+        sys.r_override        = saved_sys.r_override;
+        sys.spindle_speed_ovr = saved_sys.spindle_speed_ovr;
+        sys.spindle_speed     = saved_sys.spindle_speed;
+        plan_reset();
+        Stepper::reset();
+        plan_sync_position();
+        active = false;
+        set_state(State::Idle);
+    }
+
+    void end(Channel& out) {
+        flush();
+        report(out);
+        restore();
+    }
+
+    Error run(Channel* in, Channel& out) {
+        // The lines come from here, so the polling task must not take them
+        pollingPaused = true;
+        Job::nest(in, &out);
+        begin();
+
+        char  line[Channel::maxLine];
+        Error status;
+        while (!sys.abort && (status = in->pollLine(line)) == Error::Ok) {
+            // The polling task is paused, so look for a reset or other realtime command here
+            pollChannels();
+            protocol_exec_rt_system();
+            if (sys.abort) {
+                break;
+            }
+            int              n_words;
+            const gc_word_t* words = in->preparsed(n_words);
+            status                 = words ? execute_words(words, n_words) : execute_line(line);
+            // As with a file job, unsupported commands are not fatal
+            if (status != Error::Ok && status != Error::GcodeUnsupportedCommand) {
+                log_error_to(out,
+                             static_cast<int>(status) << " (" << errorString(status) << ") in " << in->name() << " at line "
+                                                      << in->lineNumber());
+                break;
+            }
+        }
+        if (sys.abort) {
+            // The reset restarts the parser, but not the offsets and parameters
+            restore();
+            status = Error::Reset;
+        } else if (status == Error::Eof) {
+            end(out);
+            status = Error::Ok;
+        } else {
+            restore();
+        }
+
+        Job::abort();  // Also leaves any subroutine files
+        pollingPaused = false;
+        return status;
+    }
+}
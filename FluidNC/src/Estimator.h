@@ -0,0 +1,52 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+#pragma once
+
+/*
+  Estimator.h - job time estimator
+
+  Runs a job through the parser, the planner and the segment generator as
+  a real job would, but drops the step segments instead of stepping them,
+  adding up the time that the step ISR would have taken to execute them.
+  Unlike check mode, the result reflects the full velocity planning, so it
+  shows where the planner cannot reach the programmed feed rate.
+*/
+
+#include "Error.h"
+#include "GCodeLexer.h"  // gc_word_t
+
+#include <cstdint>
+
+class Channel;
+
+namespace Estimator {
+    // True while a job is being estimated.  The machine is in check mode,
+    // but motion still goes to the planner.
+    extern bool active;
+
+    // Starts an estimate from the current parser state.  The machine must be idle.
+    void begin();
+
+    // Executes one line of the job.  $ commands are skipped.
+    Error execute_line(char* line);
+
+    // Executes one block from a precompiled job
+    Error execute_words(const gc_word_t* words, int n_words);
+
+    // Runs one segment buffer's worth of the planned motion.  Returns false
+    // if there was nothing to run.
+    bool advance();
+
+    // Runs all of the planned motion, for a buffer synchronization
+    void flush();
+
+    // Adds the time of a dwell
+    void dwell(int32_t milliseconds);
+
+    // Reports the estimate to out, and restores the parser and planner state,
+    // the work offsets and the user parameters from before begin()
+    void end(Channel& out);
+
+    // Estimates the job read from in, which is deleted afterwards
+    Error run(Channel* in, Channel& out);
+}
@@ -255,7 +255,7 @@ static Error execute_unary(float& operand, ngc_unary_op_t operation) {
             break;
 
         case Unary_Exists:
-            // do nothing here, result for the EXISTS function is set by read_unary()
+            // do nothing here, result for the EXISTS function is set by Code_Exists
             break;
 
         case Unary_EXP:
@@ -608,45 +608,125 @@ static Error read_operation_unary(const char* line, size_t& pos, ngc_unary_op_t&
     return status;
 }
 
-/*! \brief Reads a slash and the second argument to the ATAN function,
-starting at the index given by the pos offset. Then it computes the value
-of the ATAN operation applied to the two arguments.
+/*
+  Compiled expressions
 
-\param line pointer to RS274/NGC code (block).
-\param pos offset into line where expression starts.
-\param value pointer to float where result is to be stored.
-\returns #Error::Ok enum value if processed without error, appropriate \ref Error enum value if not.
-*/
-static Error read_atan(const char* line, size_t& pos, float& value) {
-    float argument2;
+  An expression is compiled once into a program of one-byte codes in postfix
+  order, with literal numbers stored in the code after Code_Number and the
+  parameter references in a separate list that the program reads in order.
+  The compiler keeps the operator precedence stack of ngc_expr.c, which
+  evaluated while reading, and emits each operation where that code would
+  have executed it, so the operations run in the same order and give the
+  same results.
 
-    if (line[pos] != '/')
-        return Error::ExpressionSyntaxError;  // Slash missing after first ATAN argument
+  Parameters are looked up when the program runs, because they can be set,
+  created or go out of scope between evaluations, but their names and
+  numbers are only read from the text once.
+*/
 
-    pos++;
+typedef enum : uint8_t {
+    Code_Number,       // Pushes the float that follows
+    Code_Param,        // Pushes the value of the next parameter
+    Code_Indirect,     // Replaces the top with the value of the numbered parameter it names
+    Code_Exists,       // Pushes whether the next parameter exists
+    Code_Negate,       // Negates the top
+    Code_Unary,        // Applies the ngc_unary_op_t that follows to the top
+    Code_Atan,         // Replaces the top two with the ATAN of the first over the second
+    Code_Binary,       // Applies the ngc_binary_op_t that follows to the top two
+    Code_OuterBinary,  // As Code_Binary, in the outermost brackets where its error is the result
+} ngc_expr_code_t;
+
+#define MAX_EVAL_STACK 32
+#define EXPRESSION_CACHE_SETS 16
+
+// An expression being compiled, with the depth of the evaluation stack at its end
+typedef struct {
+    ngc_expr_t& expr;
+    int         depth;
+    int         max_depth;
+} ngc_compile_t;
+
+static void emit(ngc_compile_t& compile, ngc_expr_code_t code, int pushes) {
+    compile.expr.code.push_back(code);
+    compile.depth += pushes;
+    if (compile.depth > compile.max_depth) {
+        compile.max_depth = compile.depth;
+    }
+}
 
-    if (line[pos] != '[')
-        return Error::ExpressionSyntaxError;  // Left bracket missing after slash with ATAN;
+static Error compile_expression(ngc_compile_t& compile, const char* line, size_t& pos, bool outer);
 
-    Error status;
+/*! \brief Compiles the reference after a #, which pushes the value of the parameter.
 
-    if ((status = expression(line, pos, argument2)) == Error::Ok)
-        value = atan2f(value, argument2) * DEGRAD; /* value in radians, convert to degrees */
+\param compile the program being compiled.
+\param line pointer to RS274/NGC code (block).
+\param pos offset into line just past the #.
+\returns true if a valid reference was compiled.
+*/
+static bool compile_param_ref(ngc_compile_t& compile, const char* line, size_t& pos) {
+    char c = line[pos];
 
-    return status;
+    switch (c) {
+        case '#':
+            // Indirection resulting in param number
+            ++pos;
+            if (!compile_param_ref(compile, line, pos)) {
+                return false;
+            }
+            emit(compile, Code_Indirect, 0);
+            return true;
+        case '<': {
+            // Named parameter
+            param_ref_t param_ref = { "", 0 };
+            ++pos;
+            while ((c = line[pos]) && c != '>') {
+                ++pos;
+                if (!isspace(c)) {
+                    param_ref.name += toupper(c);
+                }
+            }
+            if (!c) {
+                log_debug("Missing >");
+                return false;
+            }
+            ++pos;
+            compile.expr.params.push_back(param_ref);
+            emit(compile, Code_Param, 1);
+            return true;
+        }
+        case '[': {
+            // Expression evaluating to param number
+            Error status = compile_expression(compile, line, pos, false);
+            if (status != Error::Ok) {
+                log_debug(errorString(status));
+                return false;
+            }
+            emit(compile, Code_Indirect, 0);
+            return true;
+        }
+        default: {
+            // Param number
+            float result;
+            if (!read_float(line, pos, result)) {
+                return false;
+            }
+            compile.expr.params.push_back({ "", ngc_param_id_t(result) });
+            emit(compile, Code_Param, 1);
+            return true;
+        }
+    }
 }
 
-/*! \brief Reads the value out of an unary operation of the line, starting at the
-index given by the pos offset. The ATAN operation is
-handled specially because it is followed by two arguments.
+/*! \brief Compiles an unary operation with its bracketed argument. The ATAN operation
+is handled specially because it is followed by two arguments, and EXISTS because its
+argument is the name of a parameter.
 
+\param compile the program being compiled.
 \param line pointer to RS274/NGC code (block).
-\param pos offset into line where expression starts.
-\param value pointer to float where result is to be stored.
-\returns #Error::Ok enum value if processed without error, appropriate \ref Error enum value if not.
+\param pos offset into line where the operation name starts.
+\returns #Error::Ok enum value if compiled without error, appropriate \ref Error enum value if not.
 */
-// cppcheck-suppress unusedFunction
-Error read_unary(const char* line, size_t& pos, float& value) {
+static Error compile_unary(ngc_compile_t& compile, const char* line, size_t& pos) {
     ngc_unary_op_t operation;
     Error          status;
 
@@ -658,37 +738,110 @@ Error read_unary(const char* line, size_t& pos, float& value) {
     }
     if (operation == Unary_Exists) {
         ++pos;
-        std::string arg;
+        param_ref_t param_ref = { "", 0 };
         char        c;
         while ((c = line[pos]) && c != ']') {
             ++pos;
-            arg += c;
+            param_ref.name += c;
         }
         if (!c) {
             return Error::ExpressionSyntaxError;
         }
         ++pos;
-        value = named_param_exists(arg) ? 1.0 : 0.0;
+        compile.expr.params.push_back(param_ref);
+        emit(compile, Code_Exists, 1);
         return Error::Ok;
     }
-    if ((status = expression(line, pos, value)) != Error::Ok) {
+    if ((status = compile_expression(compile, line, pos, false)) != Error::Ok) {
         return status;
     }
     if (operation == Unary_ATAN) {
-        return read_atan(line, pos, value);
+        if (line[pos] != '/') {
+            return Error::ExpressionSyntaxError;  // Slash missing after first ATAN argument
+        }
+        pos++;
+        if (line[pos] != '[') {
+            return Error::ExpressionSyntaxError;  // Left bracket missing after slash with ATAN
+        }
+        if ((status = compile_expression(compile, line, pos, false)) != Error::Ok) {
+            return status;
+        }
+        emit(compile, Code_Atan, -1);
+        return Error::Ok;
     }
-    return execute_unary(value, operation);
+    emit(compile, Code_Unary, 0);
+    compile.expr.code.push_back(operation);
+    return Error::Ok;
 }
 
-/*! \brief Evaluate expression and set result if successful.
+/*! \brief Compiles a value inside an expression: a number, a parameter, a bracketed
+expression or a unary operation, possibly with a sign. Unary operations are available
+only inside expressions because their names conflict with GCode words.
 
+\param compile the program being compiled.
+\param line pointer to RS274/NGC code (block).
+\param pos offset into line where the value starts.
+\returns true if a valid value was compiled.
+*/
+static bool compile_number(ngc_compile_t& compile, const char* line, size_t& pos) {
+    char c = line[pos];
+
+    if (c == '#') {
+        ++pos;
+        return compile_param_ref(compile, line, pos);
+    }
+    if (c == '[') {
+        Error status = compile_expression(compile, line, pos, false);
+        if (status != Error::Ok) {
+            log_debug(errorString(status));
+            return false;
+        }
+        return true;
+    }
+    if (isalpha(c)) {
+        return compile_unary(compile, line, pos) == Error::Ok;
+    }
+    if (c == '-') {
+        ++pos;
+        if (!compile_number(compile, line, pos)) {
+            return false;
+        }
+        emit(compile, Code_Negate, 0);
+        return true;
+    }
+    if (c == '+') {
+        ++pos;
+        return compile_number(compile, line, pos);
+    }
+
+    float result;
+    if (!read_float(line, pos, result)) {
+        return false;
+    }
+    emit(compile, Code_Number, 1);
+    auto& code = compile.expr.code;
+    code.insert(code.end(), reinterpret_cast<uint8_t*>(&result), reinterpret_cast<uint8_t*>(&result) + sizeof(result));
+    return true;
+}
+
+static void emit_binary(ngc_compile_t& compile, ngc_binary_op_t operation, bool outer) {
+    emit(compile, outer ? Code_OuterBinary : Code_Binary, -1);
+    compile.expr.code.push_back(operation);
+}
+
+/*! \brief Compiles a bracketed expression.
+
+Errors inside nested brackets make the value that contains them a bad number, as they
+did when values were evaluated while reading, so only the outermost brackets report
+their own errors.
+
+\param compile the program being compiled.
 \param line pointer to RS274/NGC code (block).
 \param pos offset into line where expression starts.
-\param value pointer to float where result is to be stored.
-\returns #Error::Ok enum value if evaluated without error, appropriate \ref Error enum value if not.
+\param outer whether these are the outermost brackets.
+\returns #Error::Ok enum value if compiled without error, appropriate \ref Error enum value if not.
 */
-Error expression(const char* line, size_t& pos, float& value) {
-    float           values[MAX_STACK];
+static Error compile_expression(ngc_compile_t& compile, const char* line, size_t& pos, bool outer) {
     ngc_binary_op_t operators[MAX_STACK];
     uint_fast8_t    stack_index = 1;
 
@@ -699,14 +852,14 @@ Error expression(const char* line, size_t& pos, float& value) {
 
     Error status;
 
-    if ((!read_number(line, pos, values[0], true)))
+    if ((!compile_number(compile, line, pos)))
         return Error::BadNumberFormat;
 
     if ((status = read_operation(line, pos, operators[0])) != Error::Ok)
         return status;
 
     for (; operators[0] != Binary_RightBracket;) {
-        if ((!read_number(line, pos, values[stack_index], true)))
+        if ((!compile_number(compile, line, pos)))
             return Error::BadNumberFormat;
 
         if ((status = read_operation(line, pos, operators[stack_index])) != Error::Ok)
@@ -716,15 +869,9 @@ Error expression(const char* line, size_t& pos, float& value) {
             stack_index++;
         else {  // precedence of latest operator is <= previous precedence
             for (; precedence(operators[stack_index]) <= precedence(operators[stack_index - 1]);) {
-                if ((status = execute_binary(values[stack_index - 1], operators[stack_index - 1], values[stack_index])) != Error::Ok)
-                    return status;
+                emit_binary(compile, operators[stack_index - 1], outer);
 
                 operators[stack_index - 1] = operators[stack_index];
-                // auto o1 = operators[stack_index - 1];
-                // auto o2 = operators[stack_index - 2];
-                // auto p1 = precedence(o1);
-                // auto p2 = precedence(o1);
-                // if ((stack_index > 1) && p1 <= p2)
                 if ((stack_index > 1) && precedence(operators[stack_index - 1]) <= precedence(operators[stack_index - 2]))
                     stack_index--;
                 else
@@ -733,7 +880,159 @@ Error expression(const char* line, size_t& pos, float& value) {
         }
     }
 
-    value = values[0];
+    return Error::Ok;
+}
+
+Error expression_compile(const char* line, size_t& pos, ngc_expr_t& expr) {
+    ngc_compile_t compile = { expr, 0, 0 };
+
+    expr.code.clear();
+    expr.params.clear();
+
+    Error status = compile_expression(compile, line, pos, true);
+    if (status == Error::Ok && compile.max_depth > MAX_EVAL_STACK)
+        status = Error::BadNumberFormat;  // Nested too deeply
+
+    return status;
+}
+
+Error expression_evaluate(const ngc_expr_t& expr, float& value) {
+    float       stack[MAX_EVAL_STACK];
+    float*      top   = stack;  // Past the last value
+    auto        param = expr.params.begin();
+    const auto* code  = expr.code.data();
+    const auto* end   = code + expr.code.size();
+    Error       status;
+
+    while (code != end) {
+        switch (*code++) {
+            case Code_Number:
+                memcpy(top++, code, sizeof(float));
+                code += sizeof(float);
+                break;
+
+            case Code_Param:
+                if (!get_param(*param, *top++)) {
+                    log_debug("Undefined parameter " << param->name);
+                    return Error::BadNumberFormat;
+                }
+                ++param;
+                break;
+
+            case Code_Indirect: {
+                param_ref_t param_ref = { "", ngc_param_id_t(top[-1]) };
+                if (!get_param(param_ref, top[-1])) {
+                    return Error::BadNumberFormat;
+                }
+            } break;
+
+            case Code_Exists:
+                *top++ = named_param_exists(param->name) ? 1.0 : 0.0;
+                ++param;
+                break;
+
+            case Code_Negate:
+                top[-1] = -top[-1];
+                break;
+
+            case Code_Unary:
+                if (execute_unary(top[-1], ngc_unary_op_t(*code++)) != Error::Ok)
+                    return Error::BadNumberFormat;
+                break;
+
+            case Code_Atan:
+                --top;
+                top[-1] = atan2f(top[-1], top[0]) * DEGRAD; /* value in radians, convert to degrees */
+                break;
+
+            case Code_Binary:
+                --top;
+                if ((status = execute_binary(top[-1], ngc_binary_op_t(*code++), top[0])) != Error::Ok) {
+                    log_debug(errorString(status));
+                    return Error::BadNumberFormat;
+                }
+                break;
+
+            case Code_OuterBinary:
+                --top;
+                if ((status = execute_binary(top[-1], ngc_binary_op_t(*code++), top[0])) != Error::Ok)
+                    return status;
+                break;
+
+            default:
+                return Error::ExpressionUnknownOp;
+        }
+    }
+
+    value = top[-1];
 
     return Error::Ok;
 }
+
+// A recently used expression, compiled, with the text it was compiled from
+typedef struct {
+    std::string text;
+    ngc_expr_t  expr;
+} ngc_cached_expr_t;
+
+// Each set holds two expressions with the same hash, and which of them was used last
+static struct {
+    ngc_cached_expr_t entries[2];
+    uint8_t           last;
+} expression_cache[EXPRESSION_CACHE_SETS];
+
+// Picks the cache set for the expression at line, from its text up to the matching bracket
+static size_t expression_cache_set(const char* line) {
+    uint32_t hash  = 2166136261;  // FNV-1a
+    int      depth = 0;
+    char     c;
+    while ((c = *line++)) {
+        hash = (hash ^ uint8_t(c)) * 16777619;
+        if (c == '[') {
+            ++depth;
+        } else if (c == ']' && --depth <= 0) {
+            break;
+        }
+    }
+    return hash % EXPRESSION_CACHE_SETS;
+}
+
+// Whether entry holds the expression at the start of line.  The compiler never looks past
+// the closing bracket, so text that starts with the same expression compiles the same way.
+static bool expression_cached(const ngc_cached_expr_t& entry, const char* line) {
+    size_t len = entry.text.length();
+    return len && !strncmp(line, entry.text.c_str(), len);
+}
+
+/*! \brief Evaluate expression and set result if successful.
+
+\param line pointer to RS274/NGC code (block).
+\param pos offset into line where expression starts.
+\param value pointer to float where result is to be stored.
+\returns #Error::Ok enum value if evaluated without error, appropriate \ref Error enum value if not.
+*/
+Error expression(const char* line, size_t& pos, float& value) {
+    auto& set = expression_cache[expression_cache_set(line + pos)];
+
+    if (!expression_cached(set.entries[set.last], line + pos)) {
+        // Replaces the one used less recently if neither matches
+        set.last ^= 1;
+        auto& entry = set.entries[set.last];
+        if (!expression_cached(entry, line + pos)) {
+            size_t start = pos;
+            entry.text.clear();
+
+            Error status;
+            if ((status = expression_compile(line, pos, entry.expr)) != Error::Ok)
+                return status;
+
+            entry.text.assign(line + start, pos - start);
+            return expression_evaluate(entry.expr, value);
+        }
+    }
+
+    auto& entry = set.entries[set.last];
+    pos += entry.text.length();
+
+    return expression_evaluate(entry.expr, value);
+}
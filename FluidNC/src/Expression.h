@@ -1,3 +1,25 @@
 #pragma once
+
+#include "Error.h"
+#include "Parameters.h"  // param_ref_t
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// An expression compiled to a program for a stack machine, in postfix (RPN) order,
+// with the parameter references that the program reads
+typedef struct {
+    std::vector<uint8_t>     code;
+    std::vector<param_ref_t> params;
+} ngc_expr_t;
+
+// Compiles the expression at pos and advances pos past it
+Error expression_compile(const char* line, size_t& pos, ngc_expr_t& expr);
+
+// Runs a compiled expression with the current parameter values
+Error expression_evaluate(const ngc_expr_t& expr, float& value);
+
+// Evaluates the expression at pos and advances pos past it.  Recent expressions
+// are kept compiled, so lines that run repeatedly are only parsed once.
 Error expression(const char* line, size_t& pos, float& value);
-Error read_unary(const char* line, size_t& pos, float& value);
@@ -5,11 +5,13 @@
 #include "src/Settings.h"
 #include "src/WebUI/Authentication.h"
 #include "src/Configuration/JsonGenerator.h"
-#include "src/InputFile.h"    // InputFile
-#include "src/Job.h"          // Job::
-#include "src/xmodem.h"       // xmodemReceive(), xmodemTransmit()
-#include "src/Protocol.h"     // pollingPaused
-#include "src/string_util.h"  // split_prefix()
+#include "src/InputFile.h"        // InputFile
+#include "src/BinaryInputFile.h"  // BinaryInputFile
+#include "src/Job.h"              // Job::
+#include "src/Estimator.h"        // Estimator::run()
+#include "src/xmodem.h"           // xmodemReceive(), xmodemTransmit()
+#include "src/Protocol.h"         // pollingPaused
+#include "src/string_util.h"      // split_prefix()
 
 #include "src/HashFS.h"
 
@@ -49,7 +51,11 @@ static Error openFile(const char* fs, const char* parameter, Channel& out, Input
     }
 
     try {
-        theFile = new InputFile(fs, path.c_str());
+        if (GCodeBinary::is_binary(path)) {
+            theFile = new BinaryInputFile(fs, path.c_str());
+        } else {
+            theFile = new InputFile(fs, path.c_str());
+        }
     } catch (Error err) { return err; }
     return Error::Ok;
 }
@@ -270,6 +276,88 @@ static Error runLocalFile(const char* parameter, AuthenticationLevel auth_level,
     return runFile("", parameter, auth_level, out);
 }
 
+// Reports the run time that a file job would take, without moving
+static Error estimateFile(const char* fs, const char* parameter, AuthenticationLevel auth_level, Channel& out) {
+    Error err;
+    if (Job::active()) {
+        log_string(out, "Job running");
+        return Error::IdleError;
+    }
+    InputFile* theFile;
+    if ((err = openFile(fs, parameter, out, theFile)) != Error::Ok) {
+        return err;
+    }
+    return Estimator::run(theFile, out);
+}
+
+static Error estimateSDFile(const char* parameter, AuthenticationLevel auth_level, Channel& out) {
+    return estimateFile("sd", parameter, auth_level, out);
+}
+
+static Error estimateLocalFile(const char* parameter, AuthenticationLevel auth_level, Channel& out) {
+    return estimateFile("", parameter, auth_level, out);
+}
+
+// Converts a G-code file to a precompiled .gcb file with the same name
+static Error compileFile(const char* fs, const char* parameter, AuthenticationLevel auth_level, Channel& out) {
+    if (notIdleOrAlarm()) {
+        return Error::IdleError;
+    }
+    if (GCodeBinary::is_binary(parameter)) {
+        log_error_to(out, "File is already precompiled");
+        return Error::InvalidValue;
+    }
+    InputFile* theFile;
+    Error      err;
+    if ((err = openFile(fs, parameter, out, theFile)) != Error::Ok) {
+        return err;
+    }
+
+    std::string outPath(parameter);
+    auto        dot = outPath.rfind('.');
+    if (dot == std::string::npos || outPath.find('/', dot) != std::string::npos) {
+        dot = outPath.length();
+    }
+    outPath.replace(dot, std::string::npos, ".gcb");
+
+    FileStream* outFile;
+    try {
+        outFile = new FileStream(outPath, "w", fs);
+    } catch (Error err) {
+        delete theFile;
+        return err;
+    }
+
+    GCodeBinary::Encoder encoder;
+    char                 fileLine[Channel::maxLine];
+    size_t               written = 0;
+    while ((err = theFile->readLine(fileLine, Channel::maxLine)) == Error::Ok && (err = encoder.line(fileLine)) == Error::Ok) {
+        if (encoder.output.length() >= 512) {
+            written += outFile->write(reinterpret_cast<const uint8_t*>(encoder.output.data()), encoder.output.length());
+            encoder.output.clear();
+        }
+    }
+    written += outFile->write(reinterpret_cast<const uint8_t*>(encoder.output.data()), encoder.output.length());
+
+    if (err == Error::Eof) {
+        log_info_to(out, "Compiled " << theFile->lineNumber() << " lines, " << theFile->size() << " to " << written << " bytes in " << outPath);
+        err = Error::Ok;
+    } else {
+        log_error_to(out, errorString(err) << " at line " << theFile->lineNumber());
+    }
+    delete outFile;
+    delete theFile;
+    return err;
+}
+
+static Error compileSDFile(const char* parameter, AuthenticationLevel auth_level, Channel& out) {
+    return compileFile("sd", parameter, auth_level, out);
+}
+
+static Error compileLocalFile(const char* parameter, AuthenticationLevel auth_level, Channel& out) {
+    return compileFile("", parameter, auth_level, out);
+}
+
 static Error deleteObject(const char* fs, const char* name, Channel& out) {
     std::error_code ec;
 
@@ -652,6 +740,8 @@ void make_file_commands() {
     new WebCommand("FORMAT", WEBCMD, WA, "ESP710", "LocalFS/Format", formatLocalFS);
     new WebCommand("path", WEBCMD, WU, NULL, "LocalFS/Show", showLocalFile);
     new WebCommand("path", WEBCMD, WU, "ESP700", "LocalFS/Run", runLocalFile, nullptr);
+    new WebCommand("path", WEBCMD, WU, NULL, "LocalFS/Estimate", estimateLocalFile, notIdle);
+    new WebCommand("path", WEBCMD, WU, NULL, "LocalFS/Compile", compileLocalFile);
     new WebCommand("path", WEBCMD, WU, NULL, "LocalFS/List", listLocalFiles);
     new WebCommand("path", WEBCMD, WU, NULL, "LocalFS/ListJSON", listLocalFilesJSON);
     new WebCommand("path", WEBCMD, WU, NULL, "LocalFS/Delete", deleteLocalFile);
@@ -666,6 +756,8 @@ void make_file_commands() {
     new WebCommand("path", WEBCMD, WU, NULL, "File/ShowHash", fileShowHash);
     new WebCommand("path", WEBCMD, WU, "ESP221", "SD/Show", showSDFile);
     new WebCommand("path", WEBCMD, WU, "ESP220", "SD/Run", runSDFile, nullptr);
+    new WebCommand("path", WEBCMD, WU, NULL, "SD/Estimate", estimateSDFile, notIdle);
+    new WebCommand("path", WEBCMD, WU, NULL, "SD/Compile", compileSDFile);
     new WebCommand("file_or_directory_path", WEBCMD, WU, "ESP215", "SD/Delete", deleteSDObject);
     new WebCommand("path", WEBCMD, WU, NULL, "SD/Rename", renameSDObject);
     new WebCommand(NULL, WEBCMD, WU, "ESP210", "SD/List", listSDFiles);
@@ -40,11 +40,12 @@ typedef struct {
     ngc_cmd_t   operation;
     JobSource*  file;
     size_t      file_pos;
-    std::string expr;
+    ngc_expr_t  expr;  // WHILE condition
     uint32_t    repeats;
     bool        skip;
     bool        handled;
     bool        brk;
+    bool        looping;  // file is keeping the lines of this loop
 } ngc_stack_entry_t;
 
 std::stack<ngc_stack_entry_t> context;
@@ -81,7 +82,7 @@ static Error read_command(char* line, size_t& pos, ngc_cmd_t& operation) {
 }
 
 static Error stack_push(uint32_t o_label, ngc_cmd_t operation, bool skip) {
-    ngc_stack_entry_t ent = { o_label, operation, Job::source(), 0, "", 0, skip, false, false };
+    ngc_stack_entry_t ent = { o_label, operation, Job::source(), 0, {}, 0, skip, false, false, false };
     context.push(ent);
     return Error::Ok;
 }
@@ -89,9 +90,22 @@ static bool stack_pull(void) {
     if (context.empty()) {
         return false;
     }
+    // The file of a loop in a job that has ended is gone
+    if (context.top().looping && context.top().file == Job::source()) {
+        context.top().file->end_loop();
+    }
     context.pop();
     return true;
 }
+
+// Starts the loop on top of the stack at the next line of the job
+static void loop_start() {
+    auto& top   = context.top();
+    top.file    = Job::source();
+    top.looping = true;
+    top.file->start_loop();
+    top.file_pos = top.file->position();
+}
 void unwind_stack() {
     if (context.empty()) {
         return;
@@ -171,7 +185,7 @@ Error flowcontrol(uint32_t o_label, char* line, size_t& pos, bool& skip) {
             if (Job::active()) {
                 if (!skipping) {
                     stack_push(o_label, operation, false);
-                    context.top().file_pos = context.top().file->position();
+                    loop_start();
                 }
             } else {
                 status = Error::FlowControlNotExecutingMacro;
@@ -180,26 +194,27 @@ Error flowcontrol(uint32_t o_label, char* line, size_t& pos, bool& skip) {
 
         case Op_While:
             if (Job::active()) {
-                char* expr = line + pos;
                 if (!context.empty() && context.top().brk) {
                     if (last_op == Op_Do && o_label == context.top().o_label) {
                         stack_pull();
                     }
-                } else if (!skipping && (status = expression(line, pos, value)) == Error::Ok) {
-                    if (last_op == Op_Do) {
-                        if (o_label == context.top().o_label) {
-                            if (value) {
-                                context.top().file->set_position(context.top().file_pos);
-                            } else {
-                                stack_pull();
-                            }
+                } else if (!skipping && last_op == Op_Do) {
+                    if ((status = expression(line, pos, value)) == Error::Ok && o_label == context.top().o_label) {
+                        if (value) {
+                            context.top().file->set_position(context.top().file_pos);
+                        } else {
+                            stack_pull();
                         }
-                    } else {
+                    }
+                } else if (!skipping) {
+                    // Compiled once, and kept for ENDWHILE to evaluate on each pass
+                    ngc_expr_t expr;
+                    if ((status = expression_compile(line, pos, expr)) == Error::Ok &&
+                        (status = expression_evaluate(expr, value)) == Error::Ok) {
                         stack_push(o_label, operation, !value);
                         if (value) {
-                            context.top().expr     = expr;
-                            context.top().file     = Job::source();
-                            context.top().file_pos = context.top().file->position();
+                            context.top().expr = std::move(expr);
+                            loop_start();
                         }
                     }
                 }
@@ -212,8 +227,7 @@ Error flowcontrol(uint32_t o_label, char* line, size_t& pos, bool& skip) {
             if (Job::active()) {
                 if (last_op == Op_While) {
                     if (!skipping && o_label == context.top().o_label) {
-                        uint_fast8_t pos = 0;
-                        if (!context.top().skip && (status = expression(context.top().expr.c_str(), pos, value)) == Error::Ok) {
+                        if (!context.top().skip && (status = expression_evaluate(context.top().expr, value)) == Error::Ok) {
                             if (!(context.top().skip = value == 0)) {
                                 context.top().file->set_position(context.top().file_pos);
                             }
@@ -235,9 +249,8 @@ Error flowcontrol(uint32_t o_label, char* line, size_t& pos, bool& skip) {
                 if (!skipping && (status = expression(line, pos, value)) == Error::Ok) {
                     stack_push(o_label, operation, !value);
                     if (value) {
-                        context.top().file     = Job::source();
-                        context.top().file_pos = context.top().file->position();
-                        context.top().repeats  = (uint32_t)value;
+                        context.top().repeats = (uint32_t)value;
+                        loop_start();
                     }
                 }
             } else {
@@ -303,8 +316,7 @@ Error flowcontrol(uint32_t o_label, char* line, size_t& pos, bool& skip) {
                                 break;
 
                             case Op_While: {
-                                uint_fast8_t pos = 0;
-                                if (!context.top().skip && (status = expression(context.top().expr.c_str(), pos, value)) == Error::Ok) {
+                                if (!context.top().skip && (status = expression_evaluate(context.top().expr, value)) == Error::Ok) {
                                     if (!(context.top().skip = value == 0)) {
                                         context.top().file->set_position(context.top().file_pos);
                                     }
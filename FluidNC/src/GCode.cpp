@@ -16,10 +16,12 @@
 #include "Machine/UserInputs.h"   // read digital/analog inputs
 #include "Platform.h"             // WEAK_LINK
 #include "Job.h"                  // Job::active() and Job::channel()
+#include "Estimator.h"            // Estimator::active
 
 #include "Machine/MachineConfig.h"
 #include "Parameters.h"
 #include "Flowcontrol.h"
+#include "GCodeLexer.h"
 
 #include <string.h>  // memset
 #include <math.h>    // sqrt etc.
@@ -50,6 +52,7 @@ gc_modal_t modal_defaults = {
     // CutterCompensation::Disable,
     ToolLengthOffset::Cancel,
     CoordIndex::G54,
+    ControlMode::ExactPath,
     ProgramFlow::Running,
     {}, // 0, // CoolantState::M7,
     SpindleState::Disable,
@@ -72,6 +75,10 @@ void gc_init() {
     gc_state.modal          = modal_defaults;
     gc_state.modal.override = config->_start->_deactivateParking ? Override::Disabled : Override::ParkingMotion;
     gc_state.current_tool   = -1;
+    gc_state.path_tolerance = config->_pathTolerance;
+    if (gc_state.path_tolerance > 0.0f) {
+        gc_state.modal.control = ControlMode::Continuous;
+    }
     coords[gc_state.modal.coord_select]->get(gc_state.coord_system);
     flowcontrol_init();
 }
@@ -232,6 +239,8 @@ void gc_wco_changed() {
     allChannels.notifyWco();
 }
 
+static Error gc_execute_block(char* line, const gc_word_t* words, int n_words);
+
 // Executes one line of NUL-terminated G-Code.
 // The line may contain whitespace and comments, which are first removed,
 // and lower case characters, which are converted to upper case.
@@ -239,9 +248,25 @@ void gc_wco_changed() {
 // exported to internal functions in terms of (mm, mm/min) and absolute machine
 // coordinates, respectively.
 Error gc_execute_line(char* line) {
-    // Step 0 - remove whitespace and comments and convert to upper case
-    collapseGCode(line);
+    // Step 0 - split plain lines into words in one pass.  Otherwise, remove whitespace and
+    // comments and convert to upper case, for the word-by-word scan below.
+    gc_word_t words[MAX_GCODE_WORDS];
+    int       n_words = gc_state.skip_blocks ? -1 : gc_lex_line(line, words, MAX_GCODE_WORDS);
+    if (n_words < 0) {
+        collapseGCode(line);
+    }
+    return gc_execute_block(line, words, n_words);
+}
+
+Error gc_execute_words(const gc_word_t* words, int n_words) {
+    if (gc_state.skip_blocks) {
+        return Error::Ok;
+    }
+    return gc_execute_block(nullptr, words, n_words);
+}
 
+// Executes a block from its words, or from the collapsed line if n_words is negative
+static Error gc_execute_block(char* line, const gc_word_t* words, int n_words) {
     /* -------------------------------------------------------------------------------------
        STEP 1: Initialize parser block struct and copy current g-code state modes. The parser
        updates these modes and commands as the block line is parser and will only be used and
@@ -268,6 +293,7 @@ Error gc_execute_line(char* line) {
     bool probeNoError         = false;
     bool syncLaser            = false;
     bool disableLaser         = false;
+    bool negativeP            = false;
     bool laserIsMotion        = false;
     bool nonmodalG38          = false;  // Used for G38.6-9
     bool isWaitOnInputDigital = false;
@@ -277,7 +303,7 @@ Error gc_execute_line(char* line) {
     uint8_t pValue;                  // Integer value of P word
 
     // Determine if the line is a jogging motion or a normal g-code block.
-    if (line[0] == '$') {  // NOTE: `$J=` already parsed when passed to this function.
+    if (n_words < 0 && line[0] == '$') {  // NOTE: `$J=` already parsed when passed to this function.
         // Set G1 and G94 enforced modes to ensure accurate error checks.
         jogMotion                = true;
         gc_block.modal.motion    = Motion::Linear;
@@ -297,36 +323,50 @@ Error gc_execute_line(char* line) {
     size_t     pos;
     char       letter;
     float      value;
-    int32_t    int_value = 0;
-    int32_t    mantissa  = 0;
-    pos                  = jogMotion ? 3 : 0;  // Start parsing after `$J=` if jogging
-    while ((letter = line[pos]) != '\0') {     // Loop until no more g-code words in line.
-        if (letter == '#') {
-            if (gc_state.skip_blocks) {
-                return Error::Ok;
+    int32_t    int_value  = 0;
+    int32_t    mantissa   = 0;
+    int        word_index = 0;                  // Next word from the lexer
+    pos                   = jogMotion ? 3 : 0;  // Start parsing after `$J=` if jogging
+    while (true) {                              // Loop until no more g-code words in line.
+        if (n_words >= 0) {
+            // The lexer has already read the words
+            if (word_index == n_words) {
+                break;
             }
-            pos++;
-            if (!assign_param(line, pos)) {
-                FAIL(Error::BadNumberFormat);
+            letter = words[word_index].letter;
+            value  = words[word_index].value;
+            ++word_index;
+        } else {
+            if ((letter = line[pos]) == '\0') {
+                break;
+            }
+            if (letter == '#') {
+                if (gc_state.skip_blocks) {
+                    return Error::Ok;
+                }
+                pos++;
+                if (!assign_param(line, pos)) {
+                    FAIL(Error::BadNumberFormat);
+                }
+                continue;
             }
-            continue;
-        }
 
-        // XXX Should check that no other words are also present
-        if (bitnum_is_true(value_words, GCodeWord::O)) {
-            return flowcontrol(gc_block.values.o, line, pos, gc_state.skip_blocks);
-        }
+            // XXX Should check that no other words are also present
+            if (bitnum_is_true(value_words, GCodeWord::O)) {
+                return flowcontrol(gc_block.values.o, line, pos, gc_state.skip_blocks);
+            }
 
-        // Import the next g-code word, expecting a letter followed by a value. Otherwise, error out.
-        if ((letter < 'A') || (letter > 'Z')) {
-            FAIL(Error::ExpectedCommandLetter);  // [Expected word letter]
-        }
-        pos++;
-        if (!read_number(line, pos, value)) {
-            FAIL(Error::BadNumberFormat);  // [Expected word value]
-        }
-        if (gc_state.skip_blocks && letter != 'O') {
-            return Error::Ok;
+            // Import the next g-code word, expecting a letter followed by a value. Otherwise, error out.
+            if ((letter < 'A') || (letter > 'Z')) {
+                FAIL(Error::ExpectedCommandLetter);  // [Expected word letter]
+            }
+            pos++;
+            if (!read_number(line, pos, value)) {
+                FAIL(Error::BadNumberFormat);  // [Expected word value]
+            }
+            if (gc_state.skip_blocks && letter != 'O') {
+                return Error::Ok;
+            }
         }
 
         // Convert values to smaller uint8 significand and mantissa values for parsing this word.
@@ -418,6 +458,21 @@ Error gc_execute_line(char* line) {
                         gc_block.modal.motion = Motion::CcwArc;
                         mg_word_bit           = ModalGroup::MG1;
                         break;
+                    case 5:  // G5 - cubic spline, G5.1 - quadratic spline
+                        axis_command = AxisCommand::MotionMode;
+                        switch (mantissa) {
+                            case 0:
+                                gc_block.modal.motion = Motion::CubicSpline;
+                                break;
+                            case 10:
+                                gc_block.modal.motion = Motion::QuadraticSpline;
+                                break;
+                            default:
+                                FAIL(Error::GcodeUnsupportedCommand);  // [Unsupported G5.x command]
+                        }
+                        mantissa    = 0;  // Set to zero to indicate valid non-integer G command.
+                        mg_word_bit = ModalGroup::MG1;
+                        break;
                     case 38:  // G38 - probe
                         //only allow G38 "Probe" commands if a probe pin is defined.
                         if (!config->_probe->exists()) {
@@ -583,8 +638,12 @@ Error gc_execute_line(char* line) {
                         if (mantissa != 0) {
                             FAIL(Error::GcodeUnsupportedCommand);  // [G61.1 not supported]
                         }
-                        // gc_block.modal.control = ControlMode::ExactPath; // G61
-                        mg_word_bit = ModalGroup::MG13;
+                        gc_block.modal.control = ControlMode::ExactPath;  // G61
+                        mg_word_bit            = ModalGroup::MG13;
+                        break;
+                    case 64:
+                        gc_block.modal.control = ControlMode::Continuous;  // G64
+                        mg_word_bit            = ModalGroup::MG13;
                         break;
                     default:
                         FAIL(Error::GcodeUnsupportedCommand);  // [Unsupported G command]
@@ -868,12 +927,16 @@ Error gc_execute_line(char* line) {
                 }
                 // Check for invalid negative values for words F, N, P, T, and S.
                 // NOTE: Negative value check is done here simply for code-efficiency.
-                if (bitmask & (bitnum_to_mask(GCodeWord::F) | bitnum_to_mask(GCodeWord::N) | bitnum_to_mask(GCodeWord::P) |
-                               bitnum_to_mask(GCodeWord::T) | bitnum_to_mask(GCodeWord::S))) {
+                if (bitmask & (bitnum_to_mask(GCodeWord::F) | bitnum_to_mask(GCodeWord::N) | bitnum_to_mask(GCodeWord::T) |
+                               bitnum_to_mask(GCodeWord::S))) {
                     if (value < 0.0) {
                         FAIL(Error::NegativeValue);  // [Word value cannot be negative]
                     }
                 }
+                // P is checked once the motion mode is known, since it is an offset for G5
+                if (bitmask == bitnum_to_mask(GCodeWord::P) && value < 0.0) {
+                    negativeP = true;
+                }
                 value_words |= bitmask;  // Flag to indicate parameter assigned.
         }
     }
@@ -910,6 +973,10 @@ Error gc_execute_line(char* line) {
             axis_command = AxisCommand::MotionMode;  // Assign implicit motion-mode
         }
     }
+    // Check for invalid negative P value, except as the control point offset of G5.
+    if (negativeP && !(gc_block.modal.motion == Motion::CubicSpline && axis_command == AxisCommand::MotionMode)) {
+        FAIL(Error::NegativeValue);  // [Word value cannot be negative]
+    }
     // Check for valid line number N value.
     if (bitnum_is_true(value_words, GCodeWord::N)) {
         // Line number value cannot be less than zero (done) or greater than max line number.
@@ -1127,7 +1194,20 @@ Error gc_execute_line(char* line) {
             coords[gc_block.modal.coord_select]->get(block_coord_system);
         }
     }
-    // [16. Set path control mode ]: N/A. Only G61. G61.1 and G64 NOT SUPPORTED.
+    // [16. Set path control mode ]: G61.1 NOT SUPPORTED. G64 P is the tolerance for merging lines.
+    if (bitnum_is_true(command_words, ModalGroup::MG13) && gc_block.modal.control == ControlMode::Continuous) {
+        if (bitnum_is_true(value_words, GCodeWord::P)) {
+            if (gc_block.values.p < 0.0f) {
+                FAIL(Error::NegativeValue);  // [G64 P cannot be negative]
+            }
+            if (gc_block.modal.units == Units::Inches) {
+                gc_block.values.p *= MM_PER_INCH;
+            }
+            clear_bitnum(value_words, GCodeWord::P);
+        } else {
+            gc_block.values.p = config->_pathTolerance;
+        }
+    }
     // [17. Set distance mode ]: N/A. Only G91.1. G90.1 NOT SUPPORTED.
     // [18. Set retract mode ]: NOT SUPPORTED.
     // [19. Remaining non-modal actions ]: Check go to predefined position, set G10, or set axis offsets.
@@ -1462,6 +1542,45 @@ Error gc_execute_line(char* line) {
                     }
                     clear_bitnum(value_words, GCodeWord::P);
                     break;
+                case Motion::CubicSpline:
+                case Motion::QuadraticSpline:
+                    // [G5/G5.1 Errors]: No axis words. Plane is not G17. I and J are not both given, except for a G5
+                    //   that follows another G5, where missing I,J mirror the previous P,Q. G5 without both P and Q.
+                    // NOTE: I,J are the offset from the current point to the first control point, and P,Q the offset
+                    //   from the target to the second control point.
+                    if (!axis_words) {
+                        FAIL(Error::GcodeNoAxisWords);  // [No axis words]
+                    }
+                    if (gc_block.modal.plane_select != Plane::XY) {
+                        FAIL(Error::GcodeUnsupportedCommand);  // [Splines are only in the XY plane]
+                    }
+                    if (ijk_words & bitnum_to_mask(Z_AXIS)) {
+                        FAIL(Error::GcodeUnusedWords);  // [K word]
+                    }
+                    if (ijk_words == 0 && gc_block.modal.motion == Motion::CubicSpline && gc_state.modal.motion == Motion::CubicSpline) {
+                        gc_block.values.ijk[X_AXIS] = -gc_state.spline_pq[0];
+                        gc_block.values.ijk[Y_AXIS] = -gc_state.spline_pq[1];
+                    } else {
+                        if (ijk_words != (bitnum_to_mask(X_AXIS) | bitnum_to_mask(Y_AXIS))) {
+                            FAIL(Error::GcodeNoOffsetsInPlane);  // [I or J missing]
+                        }
+                        if (!nonmodalG38 && gc_block.modal.units == Units::Inches) {
+                            gc_block.values.ijk[X_AXIS] *= MM_PER_INCH;
+                            gc_block.values.ijk[Y_AXIS] *= MM_PER_INCH;
+                        }
+                    }
+                    clear_bits(value_words, (bitnum_to_mask(GCodeWord::I) | bitnum_to_mask(GCodeWord::J)));
+                    if (gc_block.modal.motion == Motion::CubicSpline) {
+                        if (bitnum_is_false(value_words, GCodeWord::P) || bitnum_is_false(value_words, GCodeWord::Q)) {
+                            FAIL(Error::GcodeNoOffsetsInPlane);  // [P or Q missing]
+                        }
+                        if (!nonmodalG38 && gc_block.modal.units == Units::Inches) {
+                            gc_block.values.p *= MM_PER_INCH;
+                            gc_block.values.q *= MM_PER_INCH;
+                        }
+                        clear_bits(value_words, (bitnum_to_mask(GCodeWord::P) | bitnum_to_mask(GCodeWord::Q)));
+                    }
+                    break;
                 case Motion::ProbeTowardNoError:
                 case Motion::ProbeAwayNoError:
                     probeNoError = true;  // No break intentional.
@@ -1550,9 +1669,11 @@ Error gc_execute_line(char* line) {
     // If in laser mode, setup laser power based on current and past parser conditions.
     if (spindle->isRateAdjusted()) {
         bool blockIsFeedrateMotion = (gc_block.modal.motion == Motion::Linear) || (gc_block.modal.motion == Motion::CwArc) ||
-                                     (gc_block.modal.motion == Motion::CcwArc);
+                                     (gc_block.modal.motion == Motion::CcwArc) || (gc_block.modal.motion == Motion::CubicSpline) ||
+                                     (gc_block.modal.motion == Motion::QuadraticSpline);
         bool stateIsFeedrateMotion = (gc_state.modal.motion == Motion::Linear) || (gc_state.modal.motion == Motion::CwArc) ||
-                                     (gc_state.modal.motion == Motion::CcwArc);
+                                     (gc_state.modal.motion == Motion::CcwArc) || (gc_state.modal.motion == Motion::CubicSpline) ||
+                                     (gc_state.modal.motion == Motion::QuadraticSpline);
 
         if (!blockIsFeedrateMotion) {
             // If the new mode is not a feedrate move (G1/2/3) we want the laser off
@@ -1615,21 +1736,26 @@ Error gc_execute_line(char* line) {
             bool new_spindle     = false;   // was the spindle changed
             protocol_buffer_synchronize();  // wait for motion in buffer to finish
 
-            Spindles::Spindle::switchSpindle(
-                gc_state.selected_tool, Spindles::SpindleFactory::objects(), spindle, stopped_spindle, new_spindle);
-            if (stopped_spindle) {
-                gc_block.modal.spindle = SpindleState::Disable;
-            }
-            if (new_spindle) {
-                gc_state.spindle_speed = 0.0;
-            }
-            log_info("Sel:" << gc_state.selected_tool << " Cur:" << gc_state.current_tool);
-            spindle->tool_change(gc_state.selected_tool, false, false);
-            if (spindle->_atc_name == "" && spindle->_m6_macro.get().empty()) {  // if neither of these exist we need to set the value here
+            if (Estimator::active) {
+                // The time estimate only needs to know which tool is in use
                 gc_state.current_tool = gc_state.selected_tool;
+            } else {
+                Spindles::Spindle::switchSpindle(
+                    gc_state.selected_tool, Spindles::SpindleFactory::objects(), spindle, stopped_spindle, new_spindle);
+                if (stopped_spindle) {
+                    gc_block.modal.spindle = SpindleState::Disable;
+                }
+                if (new_spindle) {
+                    gc_state.spindle_speed = 0.0;
+                }
+                log_info("Sel:" << gc_state.selected_tool << " Cur:" << gc_state.current_tool);
+                spindle->tool_change(gc_state.selected_tool, false, false);
+                if (spindle->_atc_name == "" && spindle->_m6_macro.get().empty()) {  // if neither of these exist we need to set the value here
+                    gc_state.current_tool = gc_state.selected_tool;
+                }
+                report_ovr_counter = 0;  // Set to report change immediately
+                gc_ovr_changed();
             }
-            report_ovr_counter = 0;  // Set to report change immediately
-            gc_ovr_changed();
         }
     }
     if (gc_block.modal.set_tool_number == SetToolNumber::Enable) {  // M61
@@ -1640,14 +1766,17 @@ Error gc_execute_line(char* line) {
         bool stopped_spindle   = false;  // was spindle stopped via the change
         bool new_spindle       = false;  // was the spindle changed
         protocol_buffer_synchronize();   // wait for motion in buffer to finish
-        Spindles::Spindle::switchSpindle(gc_state.selected_tool, Spindles::SpindleFactory::objects(), spindle, stopped_spindle, new_spindle);
-        if (stopped_spindle) {
-            gc_block.modal.spindle = SpindleState::Disable;
-        }
-        if (new_spindle) {
-            gc_state.spindle_speed = 0.0;
+        if (!Estimator::active) {
+            Spindles::Spindle::switchSpindle(
+                gc_state.selected_tool, Spindles::SpindleFactory::objects(), spindle, stopped_spindle, new_spindle);
+            if (stopped_spindle) {
+                gc_block.modal.spindle = SpindleState::Disable;
+            }
+            if (new_spindle) {
+                gc_state.spindle_speed = 0.0;
+            }
+            spindle->tool_change(gc_state.selected_tool, false, true);
         }
-        spindle->tool_change(gc_state.selected_tool, false, true);
         gc_state.current_tool = gc_block.values.q;
         report_ovr_counter    = 0;  // Set to report change immediately
         gc_ovr_changed();
@@ -1787,8 +1916,13 @@ Error gc_execute_line(char* line) {
         copyAxes(gc_state.coord_system, block_coord_system);
         gc_wco_changed();
     }
-    // [16. Set path control mode ]: G61.1/G64 NOT SUPPORTED
-    // gc_state.modal.control = gc_block.modal.control; // NOTE: Always default.
+    // [16. Set path control mode ]: G61.1 NOT SUPPORTED
+    if (bitnum_is_true(command_words, ModalGroup::MG13)) {
+        gc_state.modal.control = gc_block.modal.control;
+        if (gc_state.modal.control == ControlMode::Continuous) {
+            gc_state.path_tolerance = gc_block.values.p;
+        }
+    }
     // [17. Set distance mode ]:
     gc_state.modal.distance = gc_block.modal.distance;
     // [18. Set retract mode ]: NOT SUPPORTED
@@ -1841,11 +1975,34 @@ Error gc_execute_line(char* line) {
     if (gc_state.modal.motion != Motion::None) {
         if (axis_command == AxisCommand::MotionMode) {
             GCUpdatePos gc_update_pos = GCUpdatePos::Target;
+            if (gc_state.modal.control == ControlMode::Continuous) {
+                pl_data->path_tolerance = gc_state.path_tolerance;
+            }
             if (gc_state.modal.motion == Motion::Linear) {
                 mc_linear(gc_block.values.xyz, pl_data, gc_state.position);
             } else if (gc_state.modal.motion == Motion::Seek) {
                 pl_data->motion.rapidMotion = 1;  // Set rapid motion flag.
                 mc_linear(gc_block.values.xyz, pl_data, gc_state.position);
+            } else if ((gc_state.modal.motion == Motion::CubicSpline) || (gc_state.modal.motion == Motion::QuadraticSpline)) {
+                float* start = gc_state.position;
+                float* end   = gc_block.values.xyz;
+                float  control1[2], control2[2];
+                if (gc_state.modal.motion == Motion::CubicSpline) {
+                    control1[0]           = start[axis_0] + gc_block.values.ijk[axis_0];
+                    control1[1]           = start[axis_1] + gc_block.values.ijk[axis_1];
+                    control2[0]           = end[axis_0] + gc_block.values.p;
+                    control2[1]           = end[axis_1] + gc_block.values.q;
+                    gc_state.spline_pq[0] = gc_block.values.p;
+                    gc_state.spline_pq[1] = gc_block.values.q;
+                } else {
+                    // Raise the quadratic to the cubic with the same curve
+                    float control[2] = { start[axis_0] + gc_block.values.ijk[axis_0], start[axis_1] + gc_block.values.ijk[axis_1] };
+                    control1[0]      = start[axis_0] + (control[0] - start[axis_0]) * 2 / 3;
+                    control1[1]      = start[axis_1] + (control[1] - start[axis_1]) * 2 / 3;
+                    control2[0]      = end[axis_0] + (control[0] - end[axis_0]) * 2 / 3;
+                    control2[1]      = end[axis_1] + (control[1] - end[axis_1]) * 2 / 3;
+                }
+                mc_spline(gc_block.values.xyz, pl_data, gc_state.position, control1, control2, axis_0, axis_1);
             } else if ((gc_state.modal.motion == Motion::CwArc) || (gc_state.modal.motion == Motion::CcwArc)) {
                 mc_arc(gc_block.values.xyz,
                        pl_data,
@@ -1863,6 +2020,7 @@ Error gc_execute_line(char* line) {
                 if (!ALLOW_FEED_OVERRIDE_DURING_PROBE_CYCLES) {
                     pl_data->motion.noFeedOverride = 1;
                 }
+                pl_data->path_tolerance = 0.0f;  // Probe motions are never merged
                 gc_update_pos = mc_probe_cycle(gc_block.values.xyz, pl_data, probeAway, probeNoError, axis_words, gc_block.values.p);
             }
             // As far as the parser is concerned, the position is now == target. In reality the
@@ -2006,7 +2164,7 @@ void gc_exec_linef(bool sync_after, Channel& out, const char* format, ...) {
    group 8 = {M7*} enable mist coolant (* Compile-option)
    group 9 = {M48, M49} enable/disable feed and speed override switches
    group 10 = {G98, G99} return mode canned cycles
-   group 13 = {G61.1, G64} path control mode (G61 is supported)
+   group 13 = {G61.1} path control mode (G61 and G64 are supported)
 */
 
 static std::optional<WaitOnInputMode> validate_wait_on_input_mode_value(uint8_t value) {
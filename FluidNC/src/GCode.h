@@ -8,6 +8,7 @@
 #include "Config.h"
 #include "Error.h"
 #include "SpindleDatatypes.h"
+#include "GCodeLexer.h"  // gc_word_t
 
 #include <cstdint>
 #include <optional>
@@ -39,7 +40,7 @@ enum class ModalGroup : uint8_t {
     MG7  = 7,   // [G40] Cutter radius compensation mode. G41/42 NOT SUPPORTED.
     MG8  = 8,   // [G43.1,G49] Tool length offset
     MG12 = 9,   // [G54,G55,G56,G57,G58,G59] Coordinate system selection
-    MG13 = 10,  // [G61] Control mode
+    MG13 = 10,  // [G61,G64] Control mode
     // Table 6. M-code Modal Groups
     MM4  = 11,  // [M0,M1,M2,M30] Stopping
     MM5  = 12,  // [M62,M63,M64,M65,M66,M67,M68] Digital/analog output/input
@@ -78,6 +79,8 @@ enum class Motion : gcodenum_t {
     Linear             = 10,   // G1
     CwArc              = 20,   // G2
     CcwArc             = 30,   // G3
+    CubicSpline        = 50,   // G5
+    QuadraticSpline    = 51,   // G5.1
     ProbeToward        = 382,  // G38.2
     ProbeTowardNoError = 383,  // G38.3
     ProbeAway          = 384,  // G38.4
@@ -133,7 +136,8 @@ enum class CutterCompensation : gcodenum_t {
 
 // Modal Group G13: Control mode
 enum class ControlMode : gcodenum_t {
-    ExactPath = 610,  // G61
+    ExactPath  = 610,  // G61
+    Continuous = 640,  // G64
 };
 
 // GCodeCoolant is used by the parser, where at most one of
@@ -270,14 +274,14 @@ struct gc_modal_t {
     // CutterCompensation cutter_comp;  // {G40} NOTE: Don't track. Only default supported.
     ToolLengthOffset tool_length;   // {G43.1,G49}
     CoordIndex       coord_select;  // {G54,G55,G56,G57,G58,G59}
-    // uint8_t control;      // {G61} NOTE: Don't track. Only default supported.
-    ProgramFlow   program_flow;  // {M0,M1,M2,M30}
-    CoolantState  coolant;       // {M7,M8,M9}
-    SpindleState  spindle;       // {M3,M4,M5}
-    ToolChange    tool_change;   // {M6}
-    SetToolNumber set_tool_number;
-    IoControl     io_control;  // {M62, M63, M67}
-    Override      override;    // {M56}
+    ControlMode      control;       // {G61,G64}
+    ProgramFlow      program_flow;  // {M0,M1,M2,M30}
+    CoolantState     coolant;       // {M7,M8,M9}
+    SpindleState     spindle;       // {M3,M4,M5}
+    ToolChange       tool_change;   // {M6}
+    SetToolNumber    set_tool_number;
+    IoControl        io_control;  // {M62, M63, M67}
+    Override         override;    // {M56}
 };
 
 struct gc_values_t {
@@ -298,11 +302,13 @@ struct gc_values_t {
 struct parser_state_t {
     gc_modal_t modal;
 
-    float    spindle_speed;  // RPM
-    float    feed_rate;      // Millimeters/min
-    uint32_t selected_tool;  // tool from T value
-    int32_t  current_tool;   // the tool in use. default is -1
-    int32_t  line_number;    // Last line number sent
+    float    spindle_speed;   // RPM
+    float    feed_rate;       // Millimeters/min
+    uint32_t selected_tool;   // tool from T value
+    int32_t  current_tool;    // the tool in use. default is -1
+    int32_t  line_number;     // Last line number sent
+    float    path_tolerance;  // G64 P value in mm
+    float    spline_pq[2];    // P,Q of the last G5, for a following G5 without I,J
 
     float position[MAX_N_AXIS];  // Where the interpreter considers the tool to be at this point in the code
 
@@ -335,8 +341,14 @@ void gc_init();
 
 // Execute one block of rs275/ngc/g-code
 Error gc_execute_line(char* line);
+
+// Execute a block that is already split into words, as from a precompiled job file
+Error gc_execute_words(const gc_word_t* words, int n_words);
 void  gc_exec_linef(bool sync_after, Channel& out, const char* format, ...);
 
+// Remove whitespace and comments from line in place and convert it to upper case
+void collapseGCode(char* line);
+
 // Set g-code parser position. Input in steps.
 void gc_sync_position();
 
@@ -0,0 +1,176 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+#include "GCodeBinary.h"
+
+#include "Config.h"     // MAX_N_AXIS, for NutsBolts.h
+#include "NutsBolts.h"  // uint_to_float()
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <strings.h>  // strcasecmp()
+
+namespace GCodeBinary {
+    static void put_varint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out += char(value | 0x80);
+            value >>= 7;
+        }
+        out += char(value);
+    }
+
+    static bool get_varint(const uint8_t*& p, const uint8_t* end, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; p != end && shift < 64; shift += 7) {
+            uint8_t byte = *p++;
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static uint32_t float_bits(float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    // Uses the decimal form with the fewest places that decodes to exactly value
+    static void put_word(std::string& out, char letter, float value) {
+        static const double scales[max_decimals + 1] = { 1, 10, 100, 1000, 10000, 100000 };
+
+        uint8_t  index    = letter - 'A';
+        bool     negative = std::signbit(value);
+        uint32_t bits     = float_bits(value);
+        for (int decimals = 0; decimals <= max_decimals; ++decimals) {
+            double scaled = fabs(double(value)) * scales[decimals];
+            if (!(scaled < 4294967296.0)) {
+                break;
+            }
+            uint32_t magnitude = uint32_t(llround(scaled));
+            float    decoded   = uint_to_float(magnitude, -decimals);
+            if (float_bits(negative ? -decoded : decoded) == bits) {
+                out += char(index | decimals << 5);
+                put_varint(out, uint64_t(magnitude) << 1 | negative);
+                return;
+            }
+        }
+        out += char(index | RAW_FLOAT << 5);
+        for (int i = 0; i < 4; ++i) {
+            out += char(bits >> (8 * i));
+        }
+    }
+
+    bool is_binary(const std::string& path) {
+        auto dot = path.rfind('.');
+        return dot != std::string::npos && strcasecmp(path.c_str() + dot, ".gcb") == 0;
+    }
+
+    Error Encoder::line(const char* line) {
+        size_t len = strlen(line);
+        if (len == 0) {
+            ++_blank_lines;
+            return Error::Ok;
+        }
+        if (len >= max_text) {
+            return Error::LineLengthExceeded;
+        }
+
+        gc_word_t words[MAX_GCODE_WORDS];
+        int       n_words = gc_lex_line(line, words, MAX_GCODE_WORDS);
+        uint8_t   tag     = n_words < 0 ? TEXT : uint8_t(n_words);
+        if (_blank_lines) {
+            output += char(tag | BLANK_LINES);
+            put_varint(output, _blank_lines);
+            _blank_lines = 0;
+        } else {
+            output += char(tag);
+        }
+
+        if (n_words < 0) {
+            put_varint(output, len);
+            output.append(line, len);
+            return Error::Ok;
+        }
+        for (int i = 0; i < n_words; ++i) {
+            put_word(output, words[i].letter, words[i].value);
+        }
+        return Error::Ok;
+    }
+
+    bool decode(const uint8_t*& p, const uint8_t* end, size_t& blank_lines, gc_word_t* words, int& n_words, char* text) {
+        if (p == end) {
+            return false;
+        }
+        uint8_t  tag = *p++;
+        uint64_t value;
+
+        blank_lines = 0;
+        if (tag & BLANK_LINES) {
+            if (!get_varint(p, end, value)) {
+                return false;
+            }
+            blank_lines = value;
+        }
+
+        uint8_t kind = tag & ~BLANK_LINES;
+        if (kind == TEXT) {
+            if (!get_varint(p, end, value) || value > max_text || value > size_t(end - p)) {
+                return false;
+            }
+            memcpy(text, p, value);
+            text[value] = '\0';
+            p += value;
+            n_words = -1;
+            return true;
+        }
+        if (kind > MAX_GCODE_WORDS) {
+            return false;
+        }
+
+        for (int i = 0; i < kind; ++i) {
+            if (p == end) {
+                return false;
+            }
+            uint8_t word  = *p++;
+            uint8_t index = word & 0x1f;
+            uint8_t form  = word >> 5;
+            if (index >= 26) {
+                return false;
+            }
+            words[i].letter = 'A' + index;
+            if (form == RAW_FLOAT) {
+                if (end - p < 4) {
+                    return false;
+                }
+                uint32_t bits = p[0] | p[1] << 8 | p[2] << 16 | uint32_t(p[3]) << 24;
+                memcpy(&words[i].value, &bits, sizeof(bits));
+                p += 4;
+            } else if (form <= max_decimals) {
+                if (!get_varint(p, end, value) || value >> 33) {
+                    return false;
+                }
+                float magnitude = uint_to_float(uint32_t(value >> 1), -form);
+                words[i].value  = (value & 1) ? -magnitude : magnitude;
+            } else {
+                return false;
+            }
+        }
+        n_words = kind;
+        return true;
+    }
+
+    void format(const gc_word_t* words, int n_words, char* line, size_t len) {
+        size_t pos = 0;
+        line[0]    = '\0';
+        for (int i = 0; i < n_words && pos < len; ++i) {
+            int n = snprintf(line + pos, len - pos, "%s%c%.7g", i ? " " : "", words[i].letter, double(words[i].value));
+            if (n < 0) {
+                break;
+            }
+            pos += n;
+        }
+    }
+}
@@ -0,0 +1,79 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+#pragma once
+
+/*
+  GCodeBinary.h - precompiled G-code job files
+
+  A .gcb file holds a G-code program whose lines have already been split
+  into words by gc_lex_line(), so running it skips the text parser.  The
+  file starts with the signature "GCB1", followed by one record per line
+  of the original program:
+
+    tag      bits 0-6 are the kind of record: 0-32 for a block of that
+             many words, or TEXT for a line that needs the full parser.
+             Bit 7 means that a varint count of blank lines that were
+             dropped before this line follows the tag.
+    word     one byte with the letter (0 for A) in bits 0-4 and the form
+             of the value in bits 5-7.  Forms 0-5 are followed by the
+             varint (magnitude << 1 | negative), which has that many
+             decimal places.  Form 6 is followed by the four bytes of
+             the float, least significant first.
+    text     a varint length and the characters of the line
+
+  Varints have seven bits per byte, least significant first, with bit 7
+  set on all but the last byte.  A value like X12.345 takes three bytes
+  instead of the eight of its text with a space.
+
+  The values decode to exactly the floats that read_float() gives for
+  the original text, and comment-only lines keep their (empty) records,
+  so the line numbers in error messages and the % handling of the
+  original file still apply.  Modal words are kept even when they
+  repeat, because a line that fails on the machine would leave the
+  converter's idea of the modal state wrong.
+*/
+
+#include "Error.h"
+#include "GCodeLexer.h"  // gc_word_t
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace GCodeBinary {
+    const char     signature[]    = "GCB1";
+    const size_t   signature_size = 4;
+    const uint8_t  TEXT           = 0x40;  // Record kind for a line of text
+    const uint8_t  BLANK_LINES    = 0x80;  // Tag flag for a blank line count
+    const uint8_t  RAW_FLOAT      = 6;     // Word form for a four byte float
+    const int      max_decimals   = 5;     // Largest decimal form
+    const unsigned max_text       = 255;   // Channel::maxLine
+
+    // Space for the longest record, so that a reader can decode from a buffer holding that much
+    const size_t max_record = 1 + 5 + 2 + max_text;
+
+    // Whether path names a precompiled file
+    bool is_binary(const std::string& path);
+
+    // Converts a program one line at a time
+    class Encoder {
+        size_t _blank_lines = 0;
+
+    public:
+        std::string output;  // The records so far; the caller may write and clear it between lines
+
+        Encoder() : output(signature, signature_size) {}
+
+        // Appends the record for line, which has no line ending
+        Error line(const char* line);
+    };
+
+    // Decodes the record at p, stopping at end, and advances p past it.  For a block,
+    // sets n_words and fills words; for a line of text, sets n_words to -1 and copies
+    // the line to text, which has room for max_text + 1 characters.  Returns false for
+    // a truncated or invalid record.
+    bool decode(const uint8_t*& p, const uint8_t* end, size_t& blank_lines, gc_word_t* words, int& n_words, char* text);
+
+    // Writes the words of a block as a line of text, for display
+    void format(const gc_word_t* words, int n_words, char* line, size_t len);
+}
@@ -0,0 +1,88 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+#include "GCodeLexer.h"
+
+#include "Config.h"     // MAX_N_AXIS, for NutsBolts.h
+#include "NutsBolts.h"  // read_float()
+
+#include <cctype>
+#include <cstring>
+#include <strings.h>  // strncasecmp()
+
+// Whether gcode_comment_msg() would act on the comment from start to end, which it
+// would see with the same whitespace
+static bool comment_has_message(const char* start, const char* end) {
+    size_t len = end - start;
+    for (const char* p = start; p + 3 <= end; ++p) {
+        if (p[0] == 'M' && p[1] == 'S' && p[2] == 'G') {
+            return true;
+        }
+    }
+    return len >= 6 && (strncasecmp(start, "PRINT,", 6) == 0 || strncasecmp(start, "DEBUG,", 6) == 0);
+}
+
+int gc_lex_line(const char* line, gc_word_t* words, int max_words) {
+    int         n = 0;
+    const char* p = line;
+    while (true) {
+        char c = *p;
+        if (c == '\0' || c == ';') {
+            return n;
+        }
+        if (isspace(c) || c == ')') {
+            // collapseGCode() also drops a ) that does not end a comment
+            ++p;
+            continue;
+        }
+        if (c == '(') {
+            const char* start = ++p;
+            while (*p && *p != ')') {
+                // collapseGCode() restarts the comment at a (, ends the line at a ; and
+                // acts on a %, even within a comment
+                if (*p == '(' || *p == ';' || *p == '%') {
+                    return -1;
+                }
+                ++p;
+            }
+            if (comment_has_message(start, p)) {
+                return -1;
+            }
+            if (*p) {
+                ++p;
+            }
+            continue;
+        }
+        if (!isalpha(c) || n == max_words) {
+            return -1;
+        }
+        char letter = toupper(c);
+        if (letter == 'O') {
+            return -1;
+        }
+
+        // Spaces may separate the letter from its number
+        do {
+            ++p;
+        } while (isspace(*p));
+
+        size_t pos = 0;
+        float  value;
+        if (!read_float(p, pos, value)) {
+            return -1;
+        }
+        p += pos;
+
+        // collapseGCode() would join digits that follow a space onto this number
+        const char* q = p;
+        while (isspace(*q)) {
+            ++q;
+        }
+        if (q != p && (isdigit(*q) || *q == '.')) {
+            return -1;
+        }
+
+        words[n].letter = letter;
+        words[n].value  = value;
+        ++n;
+    }
+}
@@ -0,0 +1,28 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+#pragma once
+
+/*
+  GCodeLexer.h - single pass word splitter for plain G-code lines
+
+  Most lines from CAM programs are just letters and numbers, perhaps with
+  spaces and comments.  gc_lex_line() splits such a line into its words
+  directly from the channel's buffer, which it does not modify, instead of
+  first collapsing the line in place and then scanning it again.
+
+  Anything that needs the full parser - parameters, expressions, O words,
+  jog commands, % and comments that print messages - makes gc_lex_line()
+  give up, and the caller then uses collapseGCode() and read_number().
+*/
+
+#include <cstdint>
+
+struct gc_word_t {
+    char  letter;  // Upper case
+    float value;
+};
+
+const int MAX_GCODE_WORDS = 32;  // Lines with more words use the full parser
+
+// Splits line into words.  Returns the number of words, or -1 if the line needs the full parser.
+int gc_lex_line(const char* line, gc_word_t* words, int max_words);
@@ -5,6 +5,9 @@
 
 #include "Report.h"
 
+#include <algorithm>
+#include <cstring>
+
 InputFile::InputFile(const char* defaultFs, const char* path) : FileStream(path, "r", defaultFs) {}
 /*
   Read a line from the file
@@ -35,6 +38,123 @@ Error InputFile::readLine(char* line, int maxlen) {
     return len || c >= 0 ? Error::Ok : Error::Eof;
 }
 
+Error InputFile::nextLine(char* line) {
+    _n_words = -1;
+    return readLine(line, Channel::maxLine);
+}
+
+// Returns the next line from the loop cache, or else from the file
+Error InputFile::readJobLine(char* line) {
+    if (_replay < _cache.size()) {
+        auto& cached = _cache[_replay++];
+        auto  data   = _cache_data.data() + cached.offset;
+        _n_words     = cached.n_words;
+        if (_n_words >= 0) {
+            memcpy(_words, data, _n_words * sizeof(gc_word_t));
+            line[0] = '\0';
+        } else {
+            memcpy(line, data, cached.length);
+            line[cached.length] = '\0';
+        }
+        _line_number = cached.line_number;
+        return Error::Ok;
+    }
+    if (!_recording) {
+        return nextLine(line);
+    }
+    size_t pos = _cache_end;
+    Error  err = nextLine(line);
+    if (err == Error::Ok) {
+        record(line, pos);
+    }
+    return err;
+}
+
+// Adds a line that was just read to the loop cache.  Plain lines of text are kept as
+// words, although the caller executes the text this time.  Empty lines stay text, since
+// execute_line() accepts them even where a block is locked out.
+void InputFile::record(const char* line, size_t pos) {
+    int    n_words = _n_words >= 0 ? _n_words : *line ? gc_lex_line(line, _words, MAX_GCODE_WORDS) : -1;
+    size_t length  = n_words >= 0 ? n_words * sizeof(gc_word_t) : strlen(line);
+    if (_cache_data.size() + length + (_cache.size() + 1) * sizeof(CachedLine) > loop_cache_limit) {
+        // Too long to keep, so the loop is read from the file
+        drop_cache();
+        return;
+    }
+    _cache.push_back({ pos, _line_number, uint32_t(_cache_data.size()), int16_t(n_words), uint16_t(length) });
+    _cache_data.append(n_words >= 0 ? reinterpret_cast<const char*>(_words) : line, length);
+    _cache_end = file_position();
+    _replay    = _cache.size();
+}
+
+// Stops recording, leaving the file at the position of the next line
+void InputFile::drop_cache() {
+    if (_replay < _cache.size()) {
+        file_seek(_cache[_replay].pos);
+    }
+    _cache.clear();
+    _cache.shrink_to_fit();
+    _cache_data.clear();
+    _cache_data.shrink_to_fit();
+    _replay    = 0;
+    _recording = false;
+}
+
+void InputFile::start_loop() {
+    ++_loops;
+    if (!_recording && _cache.empty()) {
+        _recording  = true;
+        _cache_line = _line_number;
+        _cache_end  = file_position();
+        _replay     = 0;
+    }
+}
+
+void InputFile::end_loop() {
+    if (_loops && --_loops == 0) {
+        drop_cache();
+    }
+}
+
+const gc_word_t* InputFile::preparsed(int& n_words) {
+    if (_n_words < 0) {
+        return nullptr;
+    }
+    n_words = _n_words;
+    return _words;
+}
+
+size_t InputFile::position() {
+    if (_replay < _cache.size()) {
+        return _cache[_replay].pos;
+    }
+    return _recording ? _cache_end : file_position();
+}
+
+void InputFile::set_position(size_t pos) {
+    if (_recording) {
+        if (pos == _cache_end) {
+            _replay      = _cache.size();
+            _line_number = _cache.empty() ? _cache_line : _cache.back().line_number;
+            return;
+        }
+        auto it = std::lower_bound(_cache.begin(), _cache.end(), pos, [](const CachedLine& l, size_t p) { return l.pos < p; });
+        if (it != _cache.end() && it->pos == pos) {
+            _replay      = it - _cache.begin();
+            _line_number = _replay ? _cache[_replay - 1].line_number : _cache_line;
+            return;
+        }
+        drop_cache();
+    }
+    file_seek(pos);
+}
+
+void InputFile::save() {
+    // The reopened file will not be where the cache expects it
+    drop_cache();
+    FileStream::save();
+}
+
 void InputFile::ack(Error status) {
     if (status != Error::Ok) {
         log_error(static_cast<int>(status) << " (" << errorString(status) << ") in " << name() << " at line " << lineNumber());
@@ -80,7 +200,7 @@ Error InputFile::pollLine(char* line) {
         end_message();
         return Error::Eof;
     }
-    switch (auto err = readLine(line, Channel::maxLine)) {
+    switch (auto err = readJobLine(line)) {
         case Error::Ok: {
             float percent_complete = ((float)position()) * 100.0f / size();
 
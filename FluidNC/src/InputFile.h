@@ -8,6 +8,8 @@
 //  - For reporting the progress of GCode execution, counts the number of lines read and
 //    the percentage of the file size that has currently been read.
 //  - For reporting status, remembers the I/O channel that started the process of using the file.
+//  - Keeps the lines of flow control loops in memory, already split into words where possible,
+//    so that later iterations neither seek nor read the file.
 // FileStream's Channel member is not that same Channel that FileStream ultimately
 // inherits from; rather it is a separate channel that is use for status reporting.
 
@@ -16,16 +18,52 @@
 #include "WebUI/Authentication.h"
 #include "FileStream.h"  // FileStream and Channel
 #include "Error.h"
+#include "GCodeLexer.h"  // gc_word_t
 
 #include <cstdint>
+#include <string>
+#include <vector>
 
 class InputFile : public FileStream {
 private:
     Error _pending_error = Error::Ok;
     void  end_message();
 
+    // A line read while a loop is running
+    struct CachedLine {
+        size_t   pos;          // File position of the line
+        size_t   line_number;  // Line number of the line
+        uint32_t offset;       // Start of its words or text in _cache_data
+        int16_t  n_words;      // -1 for a line of text
+        uint16_t length;       // Length of the text
+    };
+
+    std::vector<CachedLine> _cache;
+    std::string             _cache_data;
+    size_t                  _cache_line = 0;  // Line number before the first cached line
+    size_t                  _cache_end  = 0;  // File position after the last cached line
+    size_t                  _replay     = 0;  // Next cached line, or _cache.size() to read the file
+    int                     _loops      = 0;  // Loops running in this file
+    bool                    _recording  = false;
+
+    Error readJobLine(char* line);
+    void  record(const char* line, size_t pos);
+    void  drop_cache();
+
+protected:
     size_t _blank_lines = 0;
 
+    // The words of the last block from pollLine(), for preparsed()
+    gc_word_t _words[MAX_GCODE_WORDS];
+    int       _n_words = -1;
+
+    // Reads the next line from the file for pollLine(), setting _n_words and _words for a block
+    virtual Error nextLine(char* line);
+
+    // The position of the next line in the file, and a seek to it
+    virtual size_t file_position() { return FileStream::position(); }
+    virtual void   file_seek(size_t pos) { FileStream::set_position(pos); }
+
 public:
     // fsname is the default file system on which the file is located, in case the path does not specify
     // path is the full path to the file
@@ -45,12 +83,23 @@ public:
     // data, you either get it "immediately" or you get a response
     // saying you will never get it (error or end-of-file).
 
-    Error readLine(char* line, int len);
+    virtual Error readLine(char* line, int len);
+
+    // Size of the loop cache.  Longer loops are read from the file each time.
+    static const size_t loop_cache_limit = 8192;
 
     // Channel methods
     size_t write(uint8_t c) override { return 0; }
     void   ack(Error status) override;
     Error  pollLine(char* line) override;
 
+    const gc_word_t* preparsed(int& n_words) override;
+
+    size_t position() override;
+    void   set_position(size_t pos) override;
+    void   save() override;
+    void   start_loop() override;
+    void   end_loop() override;
+
     ~InputFile();
 };
@@ -0,0 +1,77 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+#include "IsrStats.h"
+
+#include "Channel.h"
+#include "Logging.h"             // log_info_to()
+#include "Stepping.h"            // Machine::Stepping::fStepperTimer
+#include "Driver/delay_usecs.h"  // ticks_per_us
+
+#include <cstring>
+#include <string>
+
+namespace IsrStats {
+    volatile bool enabled = false;
+
+    uint32_t  calls;
+    Histogram cycles;
+    Histogram jitter;
+    uint32_t  fill[max_fill + 1];
+    uint32_t  cpu_per_tick;
+
+    void reset() {
+        calls = 0;
+        memset(&cycles, 0, sizeof(cycles));
+        memset(&jitter, 0, sizeof(jitter));
+        memset(fill, 0, sizeof(fill));
+    }
+
+    void enable(bool on) {
+        cpu_per_tick = ticks_per_us * 1000000 / Machine::Stepping::fStepperTimer;
+        enabled      = on;
+    }
+
+    // Lists the nonempty buckets as low-high:count
+    static void report_histogram(Channel& out, const char* name, const Histogram& h) {
+        std::string buckets;
+        for (int i = 0; i < n_buckets; ++i) {
+            if (h.counts[i]) {
+                uint32_t low = i ? 1 << (i - 1) : 0;
+                buckets += " " + std::to_string(low);
+                if (i == n_buckets - 1) {
+                    buckets += "+";
+                } else if (i > 1) {
+                    buckets += "-" + std::to_string((1 << i) - 1);
+                }
+                buckets += ":" + std::to_string(h.counts[i]);
+            }
+        }
+        log_info_to(out, name << buckets << " max " << h.max);
+    }
+
+    void report(Channel& out) {
+        if (!enabled && !calls) {
+            log_info_to(out, "ISR stats are off. $Stepper/ISR=On starts them");
+            return;
+        }
+        log_info_to(out, "ISR calls: " << calls << (enabled ? "" : " (stopped)"));
+        if (!calls) {
+            return;
+        }
+        report_histogram(out, "ISR cycles:", cycles);
+        report_histogram(out, "ISR jitter cycles:", jitter);
+
+        std::string levels;
+        for (int i = 0; i <= max_fill; ++i) {
+            if (fill[i]) {
+                levels += " " + std::to_string(i) + ":" + std::to_string(fill[i]);
+            }
+        }
+        log_info_to(out, "Segments in buffer at load:" << levels);
+
+        if (cycles.max) {
+            // With the ISR taking all of the CPU at its worst case
+            log_info_to(out, "ISR ceiling: " << ticks_per_us * 1000 / cycles.max << " kHz");
+        }
+    }
+}
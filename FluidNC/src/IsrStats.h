@@ -0,0 +1,60 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+#pragma once
+
+/*
+  IsrStats.h - step ISR timing histograms
+
+  When enabled, Stepper::pulse_func() records how many CPU cycles each
+  call takes, how far each call lands from the time that the step timer
+  was programmed for, and how many segments are in the buffer when a
+  segment is loaded.  The worst execution time sets the step rate
+  ceiling of the board.  Collection is off by default and then costs
+  one test per ISR.
+
+  The jitter figure is only meaningful for the engines that run
+  pulse_func() from the step timer interrupt.
+*/
+
+#include <cstdint>
+
+class Channel;
+
+namespace IsrStats {
+    const int n_buckets = 17;  // Enough for 16-bit values, plus one for larger ones
+
+    // Histogram with power-of-two buckets.  Bucket 0 counts zeros, and bucket n counts
+    // values from 2^(n-1) to 2^n - 1.  The last bucket also counts anything larger.
+    struct Histogram {
+        uint32_t counts[n_buckets];
+        uint32_t max;
+
+        inline __attribute__((always_inline)) void add(uint32_t value) {
+            int bucket = value ? 32 - __builtin_clz(value) : 0;
+            ++counts[bucket < n_buckets ? bucket : n_buckets - 1];
+            if (value > max) {
+                max = value;
+            }
+        }
+    };
+
+    const int max_fill = 40;  // Largest segment buffer, with adaptive segments
+
+    extern volatile bool enabled;
+
+    extern uint32_t  calls;               // Calls to pulse_func() recorded
+    extern Histogram cycles;              // CPU cycles per call
+    extern Histogram jitter;              // CPU cycles between the programmed and the actual call time
+    extern uint32_t  fill[max_fill + 1];  // Segments in the buffer when the ISR loads one
+
+    // CPU cycles per step timer tick, to convert the programmed period
+    extern uint32_t cpu_per_tick;
+
+    // Clears the histograms.  Collection must be off.
+    void reset();
+
+    // Turns collection on or off
+    void enable(bool on);
+
+    void report(Channel& out);
+}
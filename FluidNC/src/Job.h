@@ -29,6 +29,8 @@ public:
     void   restore() { _channel->restore(); }
     size_t position() { return _channel->position(); }
     void   set_position(size_t pos) { _channel->set_position(pos); }
+    void   start_loop() { _channel->start_loop(); }
+    void   end_loop() { _channel->end_loop(); }
 
     Channel* channel() { return _channel; }
 
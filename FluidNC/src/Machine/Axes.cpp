@@ -46,11 +46,26 @@ namespace Machine {
         }
 
         // certain motors need features to be turned on. Check them here
+        int impulses = 1;  // In the impulse train of all the shaped axes
         for (size_t axis = X_AXIS; axis < _numberAxis; axis++) {
             auto a = _axis[axis];
             if (a) {
                 log_info("Axis " << axisName(axis) << " (" << limitsMinPosition(axis) << "," << limitsMaxPosition(axis) << ")");
                 a->init();
+
+                auto shaper = a->_shaper;
+                if (shaper && shaper->_type != InputShaper::None) {
+                    float amp[InputShaper::MAX_IMPULSES];
+                    float time[InputShaper::MAX_IMPULSES];
+                    int   n = shaper->impulses(amp, time);
+                    if (impulses * n > InputShaper::MAX_TRAIN_IMPULSES) {
+                        // The stepper leaves this shaper out when the axes before it move too
+                        log_warn("Axis " << axisName(axis) << " shaper ignored with the earlier shaped axes, over "
+                                         << InputShaper::MAX_TRAIN_IMPULSES << " impulses");
+                    } else {
+                        impulses *= n;
+                    }
+                }
             }
             auto homing = a->_homing;
             if (homing && !homing->_positiveDirection) {
@@ -59,6 +74,9 @@ namespace Machine {
         }
 
         config_motors();
+
+        // The step ISR code depends on the axis count and the motors that were just assigned
+        Stepper::select_pulse_func();
     }
 
     void IRAM_ATTR Axes::set_disable(int axis, bool disable) {
@@ -243,7 +261,7 @@ namespace Machine {
         const auto lenNames = strlen(names);
         for (int i = 0; i < lenNames; i++) {
             char  axisName = toupper(names[i]);
-            char* pos      = index(_names, axisName);
+            auto  pos      = index(_names, axisName);
             if (!pos) {
                 log_error("Invalid axis name " << names[i]);
                 retval = false;
@@ -12,6 +12,7 @@ namespace Machine {
         handler.item("max_travel_mm", _maxTravel, 0.1, 10000000.0);
         handler.item("soft_limits", _softLimits);
         handler.section("homing", _homing);
+        handler.section("shaper", _shaper);
 
         char tmp[7];
         tmp[0] = 0;
@@ -121,5 +122,8 @@ namespace Machine {
                 delete _motors[i];
             }
         }
+        if (_shaper) {
+            delete _shaper;
+        }
     }
 }
@@ -8,6 +8,7 @@
 // #include "Axes.h"
 #include "Motor.h"
 #include "Homing.h"
+#include "InputShaper.h"
 
 namespace MotorDrivers {
     class MotorDriver;
@@ -30,6 +31,8 @@ namespace Machine {
         Motor*  _motors[MAX_MOTORS_PER_AXIS];
         Homing* _homing = nullptr;
 
+        InputShaper* _shaper = nullptr;
+
         float _stepsPerMm   = 80.0f;
         float _maxRate      = 1000.0f;
         float _acceleration = 25.0f;
@@ -449,7 +449,10 @@ namespace Machine {
         mpos = get_mpos();
         log_debug("mpos transformed " << mpos[0] << "," << mpos[1] << "," << mpos[2]);
 
-        sys.step_control = {};                     // Return step control to normal operation.
+        {
+            std::lock_guard<std::recursive_mutex> lock(Stepper::prep_mutex);
+            sys.step_control = {};  // Return step control to normal operation.
+        }
         axes->set_homing_mode(_cycleAxes, false);  // tell motors homing is done
     }
 
@@ -0,0 +1,70 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+#include "InputShaper.h"
+
+#include <cmath>
+
+namespace Machine {
+    const EnumItem shaperTypes[] = { { InputShaper::None, "None" },
+                                     { InputShaper::ZV, "ZV" },
+                                     { InputShaper::ZVD, "ZVD" },
+                                     { InputShaper::MZV, "MZV" },
+                                     EnumItem(InputShaper::ZV) };
+
+    void InputShaper::group(Configuration::HandlerBase& handler) {
+        handler.item("type", _type, shaperTypes);
+        handler.item("frequency_hz", _frequency, 1.0, 500.0);
+        handler.item("damping_ratio", _damping, 0.0, 0.9);
+    }
+
+    int InputShaper::impulses(float* amplitude, float* time) const {
+        float root   = sqrtf(1.0f - _damping * _damping);
+        float period = 1.0f / (_frequency * root);  // Damped period
+        float K      = expf(-_damping * float(M_PI) / root);
+        int   n;
+
+        switch (_type) {
+            case ZV:
+                amplitude[0] = 1.0f;
+                amplitude[1] = K;
+                time[0]      = 0.0f;
+                time[1]      = 0.5f * period;
+                n            = 2;
+                break;
+            case ZVD:
+                amplitude[0] = 1.0f;
+                amplitude[1] = 2.0f * K;
+                amplitude[2] = K * K;
+                time[0]      = 0.0f;
+                time[1]      = 0.5f * period;
+                time[2]      = period;
+                n            = 3;
+                break;
+            case MZV: {
+                float Km     = expf(-0.75f * _damping * float(M_PI) / root);
+                float a1     = 1.0f - 1.0f / sqrtf(2.0f);
+                amplitude[0] = a1;
+                amplitude[1] = (sqrtf(2.0f) - 1.0f) * Km;
+                amplitude[2] = a1 * Km * Km;
+                time[0]      = 0.0f;
+                time[1]      = 0.375f * period;
+                time[2]      = 0.75f * period;
+                n            = 3;
+                break;
+            }
+            default:
+                amplitude[0] = 1.0f;
+                time[0]      = 0.0f;
+                return 1;
+        }
+
+        float sum = 0.0f;
+        for (int i = 0; i < n; i++) {
+            sum += amplitude[i];
+        }
+        for (int i = 0; i < n; i++) {
+            amplitude[i] /= sum;
+        }
+        return n;
+    }
+}
@@ -0,0 +1,39 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+#pragma once
+
+#include "src/Configuration/Configurable.h"
+#include "src/EnumItem.h"
+
+namespace Machine {
+    // An input shaper splits each change of acceleration into a train of smaller
+    // impulses, timed so that the ringing they excite at the axis' resonant
+    // frequency cancels out.
+    class InputShaper : public Configuration::Configurable {
+    public:
+        enum Type {
+            None = 0,
+            ZV,   // Zero Vibration - 2 impulses over half a period
+            ZVD,  // Zero Vibration and Derivative - 3 impulses over a period, tolerant of frequency error
+            MZV,  // Modified ZV - 3 impulses over 3/4 of a period
+        };
+
+        static const int MAX_IMPULSES = 3;
+        // The largest impulse train that the shapers of the moving axes may combine into.
+        // Shapers that would exceed it are left out of the train.
+        static const int MAX_TRAIN_IMPULSES = 9;
+
+        InputShaper() = default;
+
+        int   _type      = ZV;
+        float _frequency = 40.0f;  // Resonant frequency of the axis in Hz
+        float _damping   = 0.1f;   // Damping ratio of the resonance
+
+        // Fills in the impulse amplitudes, which sum to 1, and their times in seconds,
+        // in increasing order.  Returns the number of impulses.
+        int impulses(float* amplitude, float* time) const;
+
+        // Configuration system helpers:
+        void group(Configuration::HandlerBase& handler) override;
+    };
+}
@@ -80,11 +80,14 @@ namespace Machine {
         Uart*        _uarts[MAX_N_UARTS]         = { nullptr };
 
         float _arcTolerance      = 0.002f;
+        bool  _arcAdaptive       = false;  // Lengthen arc chords that would limit the feed rate
         float _junctionDeviation = 0.01f;
+        float _sCurveJerk        = 0.0f;  // 0 selects trapezoidal velocity profiles
+        float _pathTolerance     = 0.0f;  // Default G64 tolerance for merging short lines, 0 selects G61
         bool  _verboseErrors     = true;
         bool  _reportInches      = false;
 
-        size_t _planner_blocks = 16;
+        uint32_t _planner_blocks = 16;
 
         // Enables a special set of M-code commands that enables and disables the parking motion.
         // These are controlled by `M56`, `M56 P1`, or `M56 Px` to enable and `M56 P0` to disable.
@@ -119,7 +122,7 @@ namespace Machine {
 extern Machine::MachineConfig* config;
 
 template <typename T>
-void copyAxes(T* dest, T* src) {
+void copyAxes(T* dest, const T* src) {
     auto n_axis = Axes::_numberAxis;
     for (size_t axis = 0; axis < n_axis; axis++) {
         dest[axis] = src[axis];
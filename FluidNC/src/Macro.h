@@ -1,6 +1,8 @@
 #pragma once
 #include "Channel.h"
 
+#include <cstdarg>
+
 class Macro {
     std::string _name;
 
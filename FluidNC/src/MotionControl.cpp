@@ -13,7 +13,9 @@
 #include "Planner.h"         // plan_reset, etc
 #include "Platform.h"        // WEAK_LINK
 #include "Settings.h"        // coords
+#include "Estimator.h"       // Estimator::active
 
+#include <algorithm>  // std::clamp
 #include <cmath>
 
 // M_PI is not defined in standard C/C++ but some compilers
@@ -27,8 +29,76 @@
 // this is needed if a jogCancel comes along after we have already parsed a jog and it is in-flight.
 static volatile void* mc_pl_data_inflight;  // holds a plan_line_data_t while mc_move_motors has taken ownership of a line motion
 
+// Consecutive lines with the same line data, whose points all lie within the G64 path tolerance
+// of one longer line, are merged into one planner block.  The newest block is described by its
+// start and the ends of the lines merged into it, in motor space.
+static const size_t     MAX_MERGED_LINES = 32;
+static float            merge_start[MAX_N_AXIS];
+static float            merge_points[MAX_MERGED_LINES][MAX_N_AXIS];
+static size_t           merge_n_points;  // 0 if the newest block cannot be extended
+static plan_line_data_t merge_data;
+
+uint32_t mc_lines_planned;
+uint32_t mc_lines_merged;
+
 void mc_init() {
     mc_pl_data_inflight = NULL;
+    merge_n_points      = 0;
+}
+
+static bool same_line_data(const plan_line_data_t* a, const plan_line_data_t* b) {
+    return a->feed_rate == b->feed_rate && a->spindle_speed == b->spindle_speed && a->motion.rapidMotion == b->motion.rapidMotion &&
+           a->motion.noFeedOverride == b->motion.noFeedOverride && a->spindle == b->spindle && a->coolant.Mist == b->coolant.Mist &&
+           a->coolant.Flood == b->coolant.Flood && a->path_tolerance == b->path_tolerance;
+}
+
+static bool mergeable(const plan_line_data_t* pl_data) {
+    return pl_data->path_tolerance > 0.0f && !pl_data->is_jog && !pl_data->motion.systemMotion && !pl_data->motion.inverseTime;
+}
+
+// Returns true if every point of the newest block is within tolerance of the line from its start to target
+static bool merge_fits(const float* target, float tolerance) {
+    auto  n_axis = Axes::_numberAxis;
+    float line[MAX_N_AXIS];
+    float length_sqr = 0.0f;
+    for (size_t axis = 0; axis < n_axis; axis++) {
+        line[axis] = target[axis] - merge_start[axis];
+        length_sqr += line[axis] * line[axis];
+    }
+    if (length_sqr == 0.0f) {
+        return false;
+    }
+    float tolerance_sqr = tolerance * tolerance;
+    for (size_t i = 0; i < merge_n_points; i++) {
+        const float* point = merge_points[i];
+        // Distance to the nearest point of the line segment
+        float along = 0.0f;
+        for (size_t axis = 0; axis < n_axis; axis++) {
+            along += (point[axis] - merge_start[axis]) * line[axis];
+        }
+        along = std::clamp(along / length_sqr, 0.0f, 1.0f);
+        float distance_sqr = 0.0f;
+        for (size_t axis = 0; axis < n_axis; axis++) {
+            float d = point[axis] - merge_start[axis] - along * line[axis];
+            distance_sqr += d * d;
+        }
+        if (distance_sqr > tolerance_sqr) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Extends the newest planner block to target instead of adding a block, if the line allows it
+static bool mc_merge_line(float* target, plan_line_data_t* pl_data) {
+    if (merge_n_points == 0 || merge_n_points == MAX_MERGED_LINES || !mergeable(pl_data) || !same_line_data(pl_data, &merge_data)) {
+        return false;
+    }
+    if (!merge_fits(target, pl_data->path_tolerance) || !plan_extend_last_line(target, pl_data)) {
+        return false;
+    }
+    copyAxes(merge_points[merge_n_points++], target);
+    return true;
 }
 
 // Execute linear motor motion in absolute millimeter coordinates. Feed rate given in
@@ -50,7 +120,8 @@ bool mc_move_motors(float* target, plan_line_data_t* pl_data) {
     mc_pl_data_inflight = pl_data;
 
     // If in check gcode mode, prevent motion by blocking planner. Soft limits still work.
-    if (state_is(State::CheckMode)) {
+    // The job time estimator runs in check mode, but needs the motion to be planned.
+    if (state_is(State::CheckMode) && !Estimator::active) {
         mc_pl_data_inflight = NULL;
         return submitted_result;  // Bail, if system abort.
     }
@@ -67,10 +138,22 @@ bool mc_move_motors(float* target, plan_line_data_t* pl_data) {
     // indicates to the firmware what is a backlash compensation motion, so that the move is executed
     // without updating the machine position values. Since the position values used by the g-code
     // parser and planner are separate from the system machine positions, this is doable.
+
+    // A line that extends the newest block does not need room in the buffer
+    if (mc_merge_line(target, pl_data)) {
+        ++mc_lines_planned;
+        ++mc_lines_merged;
+        mc_pl_data_inflight = NULL;
+        return true;
+    }
+
     // If the buffer is full: good! That means we are well ahead of the robot.
     // Remain in this loop until there is room in the buffer.
-
     while (plan_check_full_buffer()) {
+        if (Estimator::active) {
+            Estimator::advance();  // Simulated motion makes room immediately
+            continue;
+        }
         protocol_auto_cycle_start();  // Auto-cycle start when buffer is full.
 
         // While we are waiting for room in the buffer, look for realtime
@@ -84,7 +167,16 @@ bool mc_move_motors(float* target, plan_line_data_t* pl_data) {
 
     // Plan and queue motion into planner buffer
     if (mc_pl_data_inflight == pl_data) {
-        plan_buffer_line(target, pl_data);
+        if (mergeable(pl_data)) {
+            plan_get_position(merge_start);
+        }
+        merge_n_points = 0;
+        if (plan_buffer_line(target, pl_data) && mergeable(pl_data)) {
+            copyAxes(merge_points[0], target);
+            merge_n_points = 1;
+            merge_data     = *pl_data;
+        }
+        ++mc_lines_planned;
         submitted_result = true;
     }
     mc_pl_data_inflight = NULL;
@@ -115,6 +207,43 @@ bool mc_linear(float* target, plan_line_data_t* pl_data, float* position) {
     return mc_linear_no_check(target, pl_data, position);
 }
 
+// Returns the number of chords for an arc. Normally the chord ends are on the arc and the chord
+// length is set by arc_tolerance alone. With arc_adaptive, chords that short are lengthened if
+// the look-ahead buffer would not hold enough of them for the planner to reach the feed rate.
+// Their ends are then moved off the arc by radius_scale, so that the arc stays within
+// arc_tolerance on both sides of each chord.
+static uint16_t arc_segments(
+    float angular_travel, float radius, plan_line_data_t* pl_data, size_t axis_0, size_t axis_1, float& radius_scale) {
+    float tolerance  = config->_arcTolerance;
+    float half_chord = sqrtf(tolerance * (2 * radius - tolerance));
+    auto  segments   = uint16_t(floorf(fabsf(0.5 * angular_travel * radius) / half_chord));
+    if (!config->_arcAdaptive || segments < 2) {
+        return segments;
+    }
+
+    auto  axis0  = Axes::_axis[axis_0];
+    auto  axis1  = Axes::_axis[axis_1];
+    float length = fabsf(angular_travel * radius);
+    float rate   = pl_data->motion.inverseTime ? pl_data->feed_rate * length : pl_data->feed_rate;
+    rate         = MIN(rate, MAX(axis0->_maxRate, axis1->_maxRate));
+    float accel  = MIN(axis0->_acceleration, axis1->_acceleration) * 60 * 60;  // mm/min^2, like the planner
+
+    // Half of the look-ahead buffer should hold the distance needed to stop from the feed rate,
+    // so that the feed rate holds while the buffer is being refilled
+    float needed = rate * rate / (2 * accel * (plan_get_block_buffer_size() / 2));
+    if (needed <= 2 * half_chord) {
+        return segments;
+    }
+    // The longest chord whose ends are out by tolerance and whose middle is in by tolerance
+    float max_chord = 2 * sqrtf(4 * tolerance * radius);
+    needed          = MIN(needed, max_chord);
+    segments        = uint16_t(ceilf(length / needed));
+
+    float half_angle = fabsf(angular_travel) / segments / 2;
+    radius_scale     = MAX((radius - tolerance) / cosf(half_angle), radius) / radius;
+    return segments;
+}
+
 // Execute an arc in offset mode format. position == current xyz, target == target xyz,
 // offset == offset from current xyz, axis_X defines circle plane in tool space, axis_linear is
 // the direction of helical travel, radius == circle radius, isclockwise boolean. Used
@@ -134,12 +263,6 @@ void mc_arc(float*            target,
             int               pword_rotations) {
     float center[3] = { position[axis_0] + offset[axis_0], position[axis_1] + offset[axis_1], 0 };
 
-    // The first two axes are the circle plane and the third is the orthogonal plane
-    size_t caxes[3] = { axis_0, axis_1, axis_linear };
-    if (config->_kinematics->invalid_arc(target, pl_data, position, center, radius, caxes, is_clockwise_arc)) {
-        return;
-    }
-
     // Radius vector from center to current location
     float radii[2] = { -offset[axis_0], -offset[axis_1] };
     float rt[2]    = { target[axis_0] - center[0], target[axis_1] - center[1] };
@@ -176,8 +299,16 @@ void mc_arc(float*            target,
     // (2x) arc_tolerance. For 99% of users, this is just fine. If a different arc segment fit
     // is desired, i.e. least-squares, midpoint on arc, just change the mm_per_arc_segment calculation.
     // For most uses, this value should not exceed 2000.
-    uint16_t segments =
-        uint16_t(floorf(fabsf(0.5 * angular_travel * radius) / sqrtf(config->_arcTolerance * (2 * radius - config->_arcTolerance))));
+    float    radius_scale = 1.0f;
+    uint16_t segments     = arc_segments(angular_travel, radius, pl_data, axis_0, axis_1, radius_scale);
+
+    // The first two axes are the circle plane and the third is the orthogonal plane.
+    // Chord ends moved out by radius_scale must be within the soft limits too.
+    size_t caxes[3] = { axis_0, axis_1, axis_linear };
+    if (config->_kinematics->invalid_arc(target, pl_data, position, center, radius * radius_scale, caxes, is_clockwise_arc)) {
+        return;
+    }
+
     if (segments) {
         // Multiply inverse feed_rate to compensate for the fact that this movement is approximated
         // by a number of discrete segments. The inverse feed_rate should be correct for the sum of
@@ -226,6 +357,7 @@ void mc_arc(float*            target,
         uint16_t i;
         size_t   count             = 0;
         float    original_feedrate = pl_data->feed_rate;  // Kinematics may alter the feedrate, so save an original copy
+        plan_begin_batch();                               // The chords are planned together
         for (i = 1; i < segments; i++) {                  // Increment (segments-1).
             if (count < N_ARC_CORRECTION) {
                 // Apply vector rotation matrix. ~40 usec
@@ -243,8 +375,8 @@ void mc_arc(float*            target,
                 count    = 0;
             }
             // Update arc_target location
-            position[axis_0] = center[0] + radii[0];
-            position[axis_1] = center[1] + radii[1];
+            position[axis_0] = center[0] + radii[0] * radius_scale;
+            position[axis_1] = center[1] + radii[1] * radius_scale;
             position[axis_linear] += linear_per_segment[axis_linear];
             for (size_t i = A_AXIS; i < n_axis; i++) {
                 position[i] += linear_per_segment[i];
@@ -256,16 +388,122 @@ void mc_arc(float*            target,
             previous_position[axis_linear] = position[axis_linear];
             // Bail mid-circle on system abort. Runtime command check already performed by mc_linear.
             if (sys.abort) {
+                plan_end_batch();
                 return;
             }
         }
     }
     // Ensure last segment arrives at target location.
     mc_linear(target, pl_data, previous_position);
+    plan_end_batch();
+}
+
+// Magnitude of the second derivative of a cubic Bezier curve at t, where d0 = P0 - 2*P1 + P2 and
+// d1 = P1 - 2*P2 + P3.  It is linear in t, so its magnitude over an interval is at most the larger
+// of its values at the two ends.
+static float spline_curvature(const float* d0, const float* d1, float t) {
+    return 6 * hypot_f(d0[0] + (d1[0] - d0[0]) * t, d0[1] + (d1[1] - d0[1]) * t);
+}
+
+// Returns the end of the chord that starts at t.  A chord over an interval of length dt is within
+// dt^2 * max|B''| / 8 of the curve, so the chord is made as long as arc_tolerance allows for the
+// largest curvature along it, and is short where the curve bends sharply and long where it is flat.
+// As with the uint16_t segment count of arcs, a curve never has more than UINT16_MAX chords, even
+// when extreme control points would need more to stay within the tolerance.
+static float spline_next(const float* d0, const float* d1, float t, float tolerance) {
+    float curvature = spline_curvature(d0, d1, t);
+    float dt        = curvature > 0 ? sqrtf(8 * tolerance / curvature) : 1.0f;
+    if (dt >= 1.0f - t) {
+        dt = 1.0f - t;
+    }
+    curvature = MAX(curvature, spline_curvature(d0, d1, t + dt));
+    if (curvature > 0) {
+        dt = MIN(dt, sqrtf(8 * tolerance / curvature));
+    }
+    dt = MAX(dt, 1.0f / UINT16_MAX);
+    return dt >= 1.0f - t ? 1.0f : t + dt;
+}
+
+// Point at t of the curve, with the non-plane axes interpolated linearly
+static void spline_point(float*       point,
+                         const float* position,
+                         const float* target,
+                         const float* control1,
+                         const float* control2,
+                         size_t       axis_0,
+                         size_t       axis_1,
+                         float        t) {
+    float s  = 1.0f - t;
+    float b0 = s * s * s;
+    float b1 = 3 * s * s * t;
+    float b2 = 3 * s * t * t;
+    float b3 = t * t * t;
+    for (size_t i = 0; i < Axes::_numberAxis; i++) {
+        point[i] = position[i] + (target[i] - position[i]) * t;
+    }
+    point[axis_0] = b0 * position[axis_0] + b1 * control1[0] + b2 * control2[0] + b3 * target[axis_0];
+    point[axis_1] = b0 * position[axis_1] + b1 * control1[1] + b2 * control2[1] + b3 * target[axis_1];
+}
+
+// Execute a cubic spline.  The curve is flattened into chords by spline_next(), and the chord ends
+// are checked against the soft limits before any of them is planned, so that a curve that bulges
+// past a limit is refused as a whole, as arcs are.
+void mc_spline(float* target, plan_line_data_t* pl_data, float* position, float* control1, float* control2, size_t axis_0, size_t axis_1) {
+    float tolerance = config->_arcTolerance;
+    float d0[2]     = { position[axis_0] - 2 * control1[0] + control2[0], position[axis_1] - 2 * control1[1] + control2[1] };
+    float d1[2]     = { control1[0] - 2 * control2[0] + target[axis_0], control1[1] - 2 * control2[1] + target[axis_1] };
+
+    float    point[MAX_N_AXIS];
+    uint32_t segments = 0;
+    for (float t = 0; t < 1.0f; segments++) {
+        t = spline_next(d0, d1, t, tolerance);
+        if (t < 1.0f && !pl_data->is_jog && !pl_data->limits_checked) {
+            spline_point(point, position, target, control1, control2, axis_0, axis_1, t);
+            if (config->_kinematics->invalid_line(point)) {
+                return;
+            }
+        }
+    }
+    if (!pl_data->is_jog && !pl_data->limits_checked) {
+        if (config->_kinematics->invalid_line(target)) {
+            return;
+        }
+        pl_data->limits_checked = true;
+    }
+
+    // The inverse time feed rate applies to the whole curve, so each chord gets its share
+    if (pl_data->motion.inverseTime) {
+        pl_data->feed_rate *= segments;
+        pl_data->motion.inverseTime = 0;
+    }
+
+    float previous_position[MAX_N_AXIS];
+    copyAxes(previous_position, position);
+    float original_feedrate = pl_data->feed_rate;  // Kinematics may alter the feedrate, so save an original copy
+    plan_begin_batch();
+    for (float t = spline_next(d0, d1, 0, tolerance); t < 1.0f; t = spline_next(d0, d1, t, tolerance)) {
+        spline_point(point, position, target, control1, control2, axis_0, axis_1, t);
+        pl_data->feed_rate = original_feedrate;
+        mc_linear(point, pl_data, previous_position);
+        copyAxes(previous_position, point);
+        // Bail mid-curve on system abort. Runtime command check already performed by mc_linear.
+        if (sys.abort) {
+            plan_end_batch();
+            return;
+        }
+    }
+    pl_data->feed_rate = original_feedrate;
+    mc_linear(target, pl_data, previous_position);
+    plan_end_batch();
 }
 
 // Execute dwell in seconds.
 bool mc_dwell(int32_t milliseconds) {
+    if (milliseconds >= 0 && Estimator::active) {
+        protocol_buffer_synchronize();
+        Estimator::dwell(milliseconds);
+        return false;
+    }
     if (milliseconds < 0 || state_is(State::CheckMode)) {
         return false;
     }
@@ -25,6 +25,10 @@ bool mc_linear(float* target, plan_line_data_t* pl_data, float* position);
 // Execute a linear motion in motor space.
 bool mc_move_motors(float* target, plan_line_data_t* pl_data);  // returns true if line was submitted to planner
 
+// Lines given to the planner by mc_move_motors(), and how many of them were merged into the previous block
+extern uint32_t mc_lines_planned;
+extern uint32_t mc_lines_merged;
+
 // Execute an arc in offset mode format. position == current xyz, target == target xyz,
 // offset == offset from current xyz, axis_XXX defines circle plane in tool space, axis_linear is
 // the direction of helical travel, radius == circle radius, is_clockwise_arc boolean. Used
@@ -40,6 +44,10 @@ void mc_arc(float*            target,
             bool              is_clockwise_arc,
             int               pword_rotations);
 
+// Execute a cubic Bezier curve in the axis_0/axis_1 plane from position to target, with control1 and
+// control2 the absolute plane coordinates of its control points. Other axes move linearly along it.
+void mc_spline(float* target, plan_line_data_t* pl_data, float* position, float* control1, float* control2, size_t axis_0, size_t axis_1);
+
 // Dwell for a specific number of seconds
 bool mc_dwell(int32_t milliseconds);
 
@@ -131,6 +131,17 @@ static float to_mm(int axis, float value) {
 }
 
 bool get_numbered_param(ngc_param_id_t id, float& result) {
+    // User parameters first, as they are read the most and overlap none of the others
+    if (can_read_float_param(id)) {
+        if (auto param = float_params.find(id); param != float_params.end()) {
+            result = param->second;
+            return true;
+        } else {
+            log_info("param #" << id << " is not found");
+            return false;
+        }
+    }
+
     int axis;
     for (auto const& [key, coord_index] : axis_params) {
         axis = id - key;
@@ -180,24 +191,9 @@ bool get_numbered_param(ngc_param_id_t id, float& result) {
         return true;
     }
 
-    if (can_read_float_param(id)) {
-        if (auto param = float_params.find(id); param != float_params.end()) {
-            result = param->second;
-            return true;
-        } else {
-            log_info("param #" << id << " is not found");
-            return false;
-        }
-    }
-
     return false;
 }
 
-// TODO - make this a variant?
-struct param_ref_t {
-    std::string    name;  // If non-empty, the parameter is named
-    ngc_param_id_t id;    // Valid if name is empty
-};
 std::vector<std::tuple<param_ref_t, float>> assignments;
 
 bool set_config_item(const std::string& name, float result) {
@@ -377,7 +373,7 @@ bool system_param_exists(const std::string& name) {
 
 // The LinuxCNC doc says that the EXISTS syntax is like EXISTS[#<_foo>]
 // For convenience, we also allow EXISTS[_foo]
-bool named_param_exists(std::string& name) {
+bool named_param_exists(const std::string& name) {
     std::string search;
     if (name.length() > 3 && name[0] == '#' && name[1] == '<' && name.back() == '>') {
         search = name.substr(2, name.length() - 3);
@@ -414,7 +410,7 @@ bool get_global_named_param(const std::string& name, float& value) {
 }
 
 bool get_param(const param_ref_t& param_ref, float& value) {
-    auto name = param_ref.name;
+    auto& name = param_ref.name;
     if (name.length()) {
         if (name[0] == '/') {
             return get_config_item(name, value);
@@ -547,7 +543,7 @@ bool set_param(const param_ref_t& param_ref, float value) {
 }
 
 // Gets a numeric value, either a literal number or a #-prefixed parameter value
-bool read_number(const char* line, size_t& pos, float& result, bool in_expression) {
+bool read_number(const char* line, size_t& pos, float& result) {
     char c = line[pos];
     if (c == '#') {
         ++pos;
@@ -569,25 +565,6 @@ bool read_number(const char* line, size_t& pos, float& result, bool in_expressio
         }
         return true;
     }
-    if (in_expression) {
-        if (isalpha(c)) {
-            // Functions are available only inside expressions because
-            // their names conflict with GCode words
-            return read_unary(line, pos, result) == Error::Ok;
-        }
-        if (c == '-') {
-            ++pos;
-            if (!read_number(line, pos, result, in_expression)) {
-                return false;
-            }
-            result = -result;
-            return true;
-        }
-        if (c == '+') {
-            ++pos;
-            return read_number(line, pos, result, in_expression);
-        }
-    }
     return read_float(line, pos, result);
 }
 
@@ -5,14 +5,26 @@
 
 #include <stddef.h>
 #include <string>
+#include <map>
 
 // TODO - make ngc_param_id_t an enum, give names to numbered parameters where
 // possible
 typedef int ngc_param_id_t;
 
+// TODO - make this a variant?
+struct param_ref_t {
+    std::string    name;  // If non-empty, the parameter is named
+    ngc_param_id_t id;    // Valid if name is empty
+};
+
+// User parameters, #1-#5000 and #5399 by number and global #<name>s by name
+extern std::map<const ngc_param_id_t, float> float_params;
+extern std::map<std::string, float>          global_named_params;
+
 bool assign_param(const char* line, size_t& pos);
-bool read_number(const char* line, size_t& pos, float& value, bool in_expression = false);
+bool read_number(const char* line, size_t& pos, float& value);
 bool perform_assignments();
-bool named_param_exists(std::string& name);
+bool get_param(const param_ref_t& param_ref, float& value);
+bool named_param_exists(const std::string& name);
 bool set_named_param(const char* name, float value);
 bool set_numbered_param(ngc_param_id_t, float value);
@@ -10,21 +10,65 @@
 
 #include "Planner.h"
 #include "Machine/MachineConfig.h"
+#include "Driver/extmem.h"
 
 #include <cstdlib>  // PSoc Required for labs
 #include <cmath>
 
-static plan_block_t* block_buffer = nullptr;  // A ring buffer for motion instructions
-static uint8_t       block_buffer_tail;       // Index of the block to process now
-static uint8_t       block_buffer_head;       // Index of the next block to be pushed
-static uint8_t       next_buffer_head;        // Index of the next buffer head
-static uint8_t       block_buffer_planned;    // Index of the optimally planned block
+static plan_block_t*      block_buffer     = nullptr;  // A ring buffer for motion instructions
+static plan_kinematics_t* block_kinematics = nullptr;  // Hot planner fields, indexed like block_buffer
+static uint32_t           block_buffer_size;           // Blocks in the ring buffer, which may be fewer than configured
+static uint32_t           block_buffer_tail;           // Index of the block to process now
+static uint32_t           block_buffer_head;           // Index of the next block to be pushed
+static uint32_t           next_buffer_head;            // Index of the next buffer head
+static uint32_t           block_buffer_planned;        // Index of the optimally planned block
+
+// Larger look-ahead buffers go in PSRAM, if the board has it, so they
+// do not use up the internal RAM that the tasks and drivers need.
+// Without PSRAM they are cut down to this size.
+// block_kinematics is always internal, since planner_recalculate() walks it on every new block.
+static const uint32_t max_internal_blocks = 128;
+
+// The buffer size to fall back to when there is not enough memory for the configured one
+static const uint32_t fallback_blocks = 16;
+
+static void plan_free() {
+    extmem_free(block_buffer);
+    free(block_kinematics);
+    block_buffer     = nullptr;
+    block_kinematics = nullptr;
+}
 
 void plan_init() {
-    if (block_buffer) {
-        delete[] block_buffer;
+    plan_free();
+
+    uint32_t n_blocks = config->_planner_blocks;
+    bool     external = false;
+    if (n_blocks > max_internal_blocks) {
+        block_buffer = static_cast<plan_block_t*>(extmem_calloc(n_blocks, sizeof(plan_block_t), &external));
+        if (!external) {
+            extmem_free(block_buffer);
+            block_buffer = nullptr;
+            log_warn("No PSRAM for " << n_blocks << " planner blocks, using " << max_internal_blocks);
+            n_blocks = max_internal_blocks;
+        }
+    }
+    if (!block_buffer) {
+        block_buffer = static_cast<plan_block_t*>(calloc(n_blocks, sizeof(plan_block_t)));
+    }
+    block_kinematics = static_cast<plan_kinematics_t*>(calloc(n_blocks, sizeof(plan_kinematics_t)));
+    if (!block_buffer || !block_kinematics) {
+        plan_free();
+        log_error("Not enough memory for " << n_blocks << " planner blocks, using " << fallback_blocks);
+        n_blocks         = fallback_blocks;
+        external         = false;
+        block_buffer     = static_cast<plan_block_t*>(calloc(n_blocks, sizeof(plan_block_t)));
+        block_kinematics = static_cast<plan_kinematics_t*>(calloc(n_blocks, sizeof(plan_kinematics_t)));
+    }
+    block_buffer_size = n_blocks;
+    if (external) {
+        log_info("Planner: " << n_blocks << " blocks in PSRAM");
     }
-    block_buffer = new plan_block_t[config->_planner_blocks];
 }
 
 // Define planner variables
@@ -36,25 +80,78 @@ typedef struct {
     float previous_nominal_speed;         // Nominal speed of previous path line segment
 } planner_t;
 static planner_t pl;
+static planner_t pl_before_last;   // The planner state before the newest block was added
+static bool      last_extendable;  // True if plan_extend_last_line() may replace the newest block
+static bool      batch_open;       // True between plan_begin_batch() and plan_end_batch()
+static bool      batch_pending;    // True if blocks were added to the batch since the last replanning
 
 // Returns the index of the next block in the ring buffer. Also called by stepper segment buffer.
-static uint8_t plan_next_block_index(uint8_t block_index) {
+static uint32_t plan_next_block_index(uint32_t block_index) {
     block_index++;
-    if (block_index == config->_planner_blocks) {
+    if (block_index == block_buffer_size) {
         block_index = 0;
     }
     return block_index;
 }
 
 // Returns the index of the previous block in the ring buffer
-static uint8_t plan_prev_block_index(uint8_t block_index) {
+static uint32_t plan_prev_block_index(uint32_t block_index) {
     if (block_index == 0) {
-        block_index = config->_planner_blocks;
+        block_index = block_buffer_size;
     }
     block_index--;
     return block_index;
 }
 
+// The configured jerk in mm/min^3, or 0 for constant-acceleration ramps
+static float ramp_jerk() {
+    return config->_sCurveJerk * (60.0f * 60.0f * 60.0f);  // mm/sec^3 to mm/min^3
+}
+
+float plan_ramp_time(float speed_change, float acceleration) {
+    float jerk = ramp_jerk();
+    if (jerk <= 0.0f) {
+        return speed_change / acceleration;
+    }
+    float tj = acceleration / jerk;  // Time for the jerk to build up the full acceleration
+    if (speed_change >= acceleration * tj) {
+        return speed_change / acceleration + tj;
+    }
+    return 2.0f * sqrtf(speed_change / jerk);  // Pure S that never reaches the full acceleration
+}
+
+float plan_ramp_distance(float speed_a, float speed_b, float acceleration) {
+    return 0.5f * (speed_a + speed_b) * plan_ramp_time(fabsf(speed_b - speed_a), acceleration);
+}
+
+float plan_reachable_speed_sqr(float speed_sqr, float acceleration, float millimeters) {
+    float jerk = ramp_jerk();
+    if (jerk <= 0.0f) {
+        return speed_sqr + 2 * acceleration * millimeters;
+    }
+    if (millimeters <= 0.0f) {
+        return speed_sqr;
+    }
+    float v  = sqrtf(speed_sqr);
+    float tj = acceleration / jerk;
+    float dv;
+    if (millimeters >= (v + 0.5f * acceleration * tj) * 2.0f * tj) {
+        // The ramp reaches the full acceleration. Solve (v + dv/2) * (dv/a + tj) = mm for dv.
+        float b = v + 0.5f * acceleration * tj;
+        dv      = sqrtf(b * b - 2.0f * acceleration * (v * tj - millimeters)) - b;
+    } else {
+        // Pure S. With x = sqrt(dv), (v + x^2/2) * 2x/sqrt(jerk) = mm is the cubic x^3 + px - q = 0,
+        // whose one real root is taken from Cardano's formula in a form without cancellation.
+        float p = 2.0f * v;
+        float q = millimeters * sqrtf(jerk);
+        float u = cbrtf(0.5f * q + sqrtf(0.25f * q * q + p * p * p / 27.0f));
+        float w = p / (3.0f * u);
+        float x = q / (u * u + p / 3.0f + w * w);
+        dv      = x * x;
+    }
+    return (v + dv) * (v + dv);
+}
+
 /*                            PLANNER SPEED DEFINITION
                                      +--------+   <- current->nominal_speed
                                     /          \
@@ -126,7 +223,7 @@ static void planner_recalculate() {
         return;
     }
     // Initialize block index to the last block in the planner buffer.
-    uint8_t block_index = plan_prev_block_index(block_buffer_head);
+    uint32_t block_index = plan_prev_block_index(block_buffer_head);
     // Bail. Can't do anything with one only one plan-able block.
     if (block_index == block_buffer_planned) {
         return;
@@ -134,29 +231,29 @@ static void planner_recalculate() {
     // Reverse Pass: Coarsely maximize all possible deceleration curves back-planning from the last
     // block in buffer. Cease planning when the last optimal planned or tail pointer is reached.
     // NOTE: Forward pass will later refine and correct the reverse pass to create an optimal plan.
-    float         entry_speed_sqr;
-    plan_block_t* next;
-    plan_block_t* current = &block_buffer[block_index];
+    float              entry_speed_sqr;
+    plan_kinematics_t* next;
+    plan_kinematics_t* current = &block_kinematics[block_index];
     // Calculate maximum entry speed for last block in buffer, where the exit speed is always zero.
-    current->entry_speed_sqr = MIN(current->max_entry_speed_sqr, 2 * current->acceleration * current->millimeters);
+    current->entry_speed_sqr = MIN(current->max_entry_speed_sqr, plan_reachable_speed_sqr(0, current->acceleration, current->millimeters));
     block_index              = plan_prev_block_index(block_index);
     if (block_index == block_buffer_planned) {  // Only two plannable blocks in buffer. Reverse pass complete.
         // Check if the first block is the tail. If so, notify stepper to update its current parameters.
         if (block_index == block_buffer_tail) {
-            Stepper::update_plan_block_parameters();
+            Stepper::update_plan_block_parameters(true);
         }
     } else {  // Three or more plan-able blocks
         while (block_index != block_buffer_planned) {
             next        = current;
-            current     = &block_buffer[block_index];
+            current     = &block_kinematics[block_index];
             block_index = plan_prev_block_index(block_index);
             // Check if next block is the tail block(=planned block). If so, update current stepper parameters.
             if (block_index == block_buffer_tail) {
-                Stepper::update_plan_block_parameters();
+                Stepper::update_plan_block_parameters(true);
             }
             // Compute maximum entry speed decelerating over the current block from its exit speed.
             if (current->entry_speed_sqr != current->max_entry_speed_sqr) {
-                entry_speed_sqr = next->entry_speed_sqr + 2 * current->acceleration * current->millimeters;
+                entry_speed_sqr = plan_reachable_speed_sqr(next->entry_speed_sqr, current->acceleration, current->millimeters);
                 if (entry_speed_sqr < current->max_entry_speed_sqr) {
                     current->entry_speed_sqr = entry_speed_sqr;
                 } else {
@@ -167,16 +264,16 @@ static void planner_recalculate() {
     }
     // Forward Pass: Forward plan the acceleration curve from the planned pointer onward.
     // Also scans for optimal plan breakpoints and appropriately updates the planned pointer.
-    next        = &block_buffer[block_buffer_planned];  // Begin at buffer planned pointer
+    next        = &block_kinematics[block_buffer_planned];  // Begin at buffer planned pointer
     block_index = plan_next_block_index(block_buffer_planned);
     while (block_index != block_buffer_head) {
         current = next;
-        next    = &block_buffer[block_index];
+        next    = &block_kinematics[block_index];
         // Any acceleration detected in the forward pass automatically moves the optimal planned
         // pointer forward, since everything before this is all optimal. In other words, nothing
         // can improve the plan from the buffer tail to the planned pointer by logic.
         if (current->entry_speed_sqr < next->entry_speed_sqr) {
-            entry_speed_sqr = current->entry_speed_sqr + 2 * current->acceleration * current->millimeters;
+            entry_speed_sqr = plan_reachable_speed_sqr(current->entry_speed_sqr, current->acceleration, current->millimeters);
             // If true, current block is full-acceleration and we can move the planned pointer forward.
             if (entry_speed_sqr < next->entry_speed_sqr) {
                 next->entry_speed_sqr = entry_speed_sqr;  // Always <= max_entry_speed_sqr. Backward pass sets this.
@@ -194,12 +291,41 @@ static void planner_recalculate() {
     }
 }
 
+// Replans now or, inside a batch, when the batch ends. The plan is always brought up to date
+// when the buffer fills, since the stepper may run while the caller waits for room.
+static void planner_update() {
+    if (batch_open && !plan_check_full_buffer()) {
+        batch_pending = true;
+        return;
+    }
+    batch_pending = false;
+    planner_recalculate();
+}
+
+void plan_begin_batch() {
+    batch_open = true;
+}
+
+void plan_end_batch() {
+    std::lock_guard<std::recursive_mutex> lock(Stepper::prep_mutex);
+
+    batch_open = false;
+    if (batch_pending) {
+        batch_pending = false;
+        planner_recalculate();
+    }
+}
+
 void plan_reset() {
+    std::lock_guard<std::recursive_mutex> lock(Stepper::prep_mutex);
+
     memset(&pl, 0, sizeof(planner_t));  // Clear planner struct
     plan_reset_buffer();
 }
 
 void plan_reset_buffer() {
+    last_extendable      = false;
+    batch_pending        = false;
     block_buffer_tail    = 0;
     block_buffer_head    = 0;  // Empty = tail
     next_buffer_head     = 1;  // plan_next_block_index(block_buffer_head)
@@ -209,7 +335,7 @@ void plan_reset_buffer() {
 // Called from stepper pulse function when the block is complete
 void plan_discard_current_block() {
     if (block_buffer_head != block_buffer_tail) {  // Discard non-empty buffer.
-        uint8_t block_index = plan_next_block_index(block_buffer_tail);
+        uint32_t block_index = plan_next_block_index(block_buffer_tail);
         // Push block_buffer_planned pointer, if encountered.
         if (block_buffer_tail == block_buffer_planned) {
             block_buffer_planned = block_index;
@@ -223,6 +349,11 @@ plan_block_t* plan_get_system_motion_block() {
     return &block_buffer[block_buffer_head];
 }
 
+// Returns the acceleration management fields of a block. Called by segment generator.
+plan_kinematics_t* plan_get_kinematics(const plan_block_t* block) {
+    return &block_kinematics[block - block_buffer];
+}
+
 // Returns address of first planner block, if available. Called by various main program functions.
 plan_block_t* plan_get_current_block() {
     if (block_buffer_head == block_buffer_tail) {
@@ -232,15 +363,15 @@ plan_block_t* plan_get_current_block() {
 }
 
 float plan_get_exec_block_exit_speed_sqr() {
-    uint8_t block_index = plan_next_block_index(block_buffer_tail);
+    uint32_t block_index = plan_next_block_index(block_buffer_tail);
     if (block_index == block_buffer_head) {
         return 0.0f;
     }
-    return block_buffer[block_index].entry_speed_sqr;
+    return block_kinematics[block_index].entry_speed_sqr;
 }
 
 // Returns the availability status of the block ring buffer. True, if full.
-uint8_t plan_check_full_buffer() {
+bool plan_check_full_buffer() {
     return block_buffer_tail == next_buffer_head;
 }
 
@@ -267,21 +398,24 @@ float plan_compute_profile_nominal_speed(plan_block_t* block) {
 // Computes and updates the max entry speed (sqr) of the block, based on the minimum of the junction's
 // previous and current nominal speeds and max junction speed.
 static void plan_compute_profile_parameters(plan_block_t* block, float nominal_speed, float prev_nominal_speed) {
+    plan_kinematics_t* kin = plan_get_kinematics(block);
     // Compute the junction maximum entry based on the minimum of the junction speed and neighboring nominal speeds.
     if (nominal_speed > prev_nominal_speed) {
-        block->max_entry_speed_sqr = prev_nominal_speed * prev_nominal_speed;
+        kin->max_entry_speed_sqr = prev_nominal_speed * prev_nominal_speed;
     } else {
-        block->max_entry_speed_sqr = nominal_speed * nominal_speed;
+        kin->max_entry_speed_sqr = nominal_speed * nominal_speed;
     }
 
-    if (block->max_entry_speed_sqr > block->max_junction_speed_sqr) {
-        block->max_entry_speed_sqr = block->max_junction_speed_sqr;
+    if (kin->max_entry_speed_sqr > block->max_junction_speed_sqr) {
+        kin->max_entry_speed_sqr = block->max_junction_speed_sqr;
     }
 }
 
 // Re-calculates buffered motions profile parameters upon a motion-based override change.
 void plan_update_velocity_profile_parameters() {
-    uint8_t       block_index = block_buffer_tail;
+    std::lock_guard<std::recursive_mutex> lock(Stepper::prep_mutex);
+
+    uint32_t      block_index = block_buffer_tail;
     plan_block_t* block;
     float         nominal_speed;
     float         prev_nominal_speed = SOME_LARGE_VALUE;  // Set high for first block nominal speed calculation.
@@ -293,15 +427,27 @@ void plan_update_velocity_profile_parameters() {
         block_index        = plan_next_block_index(block_index);
     }
     pl.previous_nominal_speed = prev_nominal_speed;  // Update prev nominal speed for next incoming block.
+    last_extendable           = false;               // pl_before_last has the old nominal speed
     if (block_buffer_tail != block_buffer_head) {
         plan_cycle_reinitialize();
     }
 }
 
-bool plan_buffer_line(float* target, plan_line_data_t* pl_data) {
+// Fills in block and kin for a line from the planner state "from" to target, without adding it to
+// the buffer. from_rest is true if the line starts from a stop. target_steps and unit_vec receive
+// the values that the planner state takes when the line is added. Returns false if the line is
+// zero-length or cannot be run.
+static bool plan_prepare_block(plan_block_t*      block,
+                               plan_kinematics_t* kin,
+                               const planner_t&   from,
+                               bool               from_rest,
+                               float*             target,
+                               plan_line_data_t*  pl_data,
+                               int32_t*           target_steps,
+                               float*             unit_vec) {
     // Prepare and initialize new block. Copy relevant pl_data for block execution.
-    plan_block_t* block = &block_buffer[block_buffer_head];
     memset(block, 0, sizeof(plan_block_t));  // Zero all block values.
+    memset(kin, 0, sizeof(plan_kinematics_t));
     block->motion        = pl_data->motion;
     block->coolant       = pl_data->coolant;
     block->spindle       = pl_data->spindle;
@@ -310,8 +456,8 @@ bool plan_buffer_line(float* target, plan_line_data_t* pl_data) {
     block->is_jog        = pl_data->is_jog;
 
     // Compute and store initial move distance data.
-    int32_t target_steps[MAX_N_AXIS], position_steps[MAX_N_AXIS];
-    float   unit_vec[MAX_N_AXIS], delta_mm;
+    int32_t position_steps[MAX_N_AXIS];
+    float   delta_mm;
     // Copy position data based on type of motion being planned.
     if (block->motion.systemMotion) {
         get_motor_steps(position_steps);
@@ -321,7 +467,7 @@ bool plan_buffer_line(float* target, plan_line_data_t* pl_data) {
             send_alarm(ExecAlarm::Unhomed);
             return false;
         }
-        copyAxes(position_steps, pl.position);
+        copyAxes(position_steps, from.position);
     }
     auto n_axis = Axes::_numberAxis;
     for (size_t idx = 0; idx < n_axis; idx++) {
@@ -347,8 +493,8 @@ bool plan_buffer_line(float* target, plan_line_data_t* pl_data) {
     // down such that no individual axes maximum values are exceeded with respect to the line direction.
     // NOTE: This calculation assumes all axes are orthogonal (Cartesian) and works with ABC-axes,
     // if they are also orthogonal/independent. Operates on the absolute value of the unit vector.
-    block->millimeters  = convert_delta_vector_to_unit_vector(unit_vec);
-    block->acceleration = limit_acceleration_by_axis_maximum(unit_vec);
+    kin->millimeters    = convert_delta_vector_to_unit_vector(unit_vec);
+    kin->acceleration   = limit_acceleration_by_axis_maximum(unit_vec);
     block->rapid_rate   = limit_rate_by_axis_maximum(unit_vec);
     // Store programmed rate.
     if (block->motion.rapidMotion) {
@@ -356,14 +502,14 @@ bool plan_buffer_line(float* target, plan_line_data_t* pl_data) {
     } else {
         block->programmed_rate = pl_data->feed_rate;
         if (block->motion.inverseTime) {
-            block->programmed_rate *= block->millimeters;
+            block->programmed_rate *= kin->millimeters;
         }
     }
     // TODO: Need to check this method handling zero junction speeds when starting from rest.
-    if ((block_buffer_head == block_buffer_tail) || (block->motion.systemMotion)) {
+    if (from_rest || (block->motion.systemMotion)) {
         // Initialize block entry speed as zero. Assume it will be starting from rest. Planner will correct this later.
         // If system motion, the system motion block always is assumed to start from rest and end at a complete stop.
-        block->entry_speed_sqr        = 0.0;
+        kin->entry_speed_sqr          = 0.0;
         block->max_junction_speed_sqr = 0.0;  // Starting from rest. Enforce start from zero velocity.
     } else {
         // Compute maximum allowable entry speed at junction by centripetal acceleration approximation.
@@ -390,8 +536,8 @@ bool plan_buffer_line(float* target, plan_line_data_t* pl_data) {
         float junction_unit_vec[MAX_N_AXIS];
         float junction_cos_theta = 0.0;
         for (size_t idx = 0; idx < n_axis; idx++) {
-            junction_cos_theta -= pl.previous_unit_vec[idx] * unit_vec[idx];
-            junction_unit_vec[idx] = unit_vec[idx] - pl.previous_unit_vec[idx];
+            junction_cos_theta -= from.previous_unit_vec[idx] * unit_vec[idx];
+            junction_unit_vec[idx] = unit_vec[idx] - from.previous_unit_vec[idx];
         }
         // NOTE: Computed without any expensive trig, sin() or acos(), by trig half angle identity of cos(theta).
         if (junction_cos_theta > 0.999999) {
@@ -411,10 +557,25 @@ bool plan_buffer_line(float* target, plan_line_data_t* pl_data) {
             }
         }
     }
+    return true;
+}
+
+bool plan_buffer_line(float* target, plan_line_data_t* pl_data) {
+    std::lock_guard<std::recursive_mutex> lock(Stepper::prep_mutex);
+
+    plan_block_t*      block = &block_buffer[block_buffer_head];
+    plan_kinematics_t* kin   = &block_kinematics[block_buffer_head];
+    int32_t            target_steps[MAX_N_AXIS];
+    float              unit_vec[MAX_N_AXIS];
+    if (!plan_prepare_block(block, kin, pl, block_buffer_head == block_buffer_tail, target, pl_data, target_steps, unit_vec)) {
+        return false;
+    }
     // Block system motion from updating this data to ensure next g-code motion is computed correctly.
     if (!(block->motion.systemMotion)) {
         float nominal_speed = plan_compute_profile_nominal_speed(block);
         plan_compute_profile_parameters(block, nominal_speed, pl.previous_nominal_speed);
+        pl_before_last            = pl;
+        last_extendable           = true;
         pl.previous_nominal_speed = nominal_speed;
         // Update previous path unit_vector and planner position.
         copyAxes(pl.previous_unit_vec, unit_vec);
@@ -423,25 +584,79 @@ bool plan_buffer_line(float* target, plan_line_data_t* pl_data) {
         block_buffer_head = next_buffer_head;
         next_buffer_head  = plan_next_block_index(block_buffer_head);
         // Finish up by recalculating the plan with the new block.
-        planner_recalculate();
+        planner_update();
+    }
+    return true;
+}
+
+// Replaces the newest block with one line from its start to target. The block at the tail may
+// already be feeding the segment buffer, so it is never replaced. Neither is a block whose
+// replacement would have a lower entry speed, since the speeds planned for the blocks before it
+// assume the old one.
+bool plan_extend_last_line(float* target, plan_line_data_t* pl_data) {
+    std::lock_guard<std::recursive_mutex> lock(Stepper::prep_mutex);
+
+    uint32_t last_index = plan_prev_block_index(block_buffer_head);
+    if (!last_extendable || block_buffer_head == block_buffer_tail || last_index == block_buffer_tail) {
+        return false;
+    }
+    // The free block at the head holds the replacement until it is known to be usable
+    plan_block_t*      block = &block_buffer[block_buffer_head];
+    plan_kinematics_t* kin   = &block_kinematics[block_buffer_head];
+    int32_t            target_steps[MAX_N_AXIS];
+    float              unit_vec[MAX_N_AXIS];
+    if (!plan_prepare_block(block, kin, pl_before_last, false, target, pl_data, target_steps, unit_vec)) {
+        return false;
     }
+    float nominal_speed = plan_compute_profile_nominal_speed(block);
+    plan_compute_profile_parameters(block, nominal_speed, pl_before_last.previous_nominal_speed);
+    float entry_speed_sqr = MIN(kin->max_entry_speed_sqr, plan_reachable_speed_sqr(0, kin->acceleration, kin->millimeters));
+    if (entry_speed_sqr < block_kinematics[last_index].entry_speed_sqr) {
+        return false;
+    }
+    block_buffer[last_index]     = *block;
+    block_kinematics[last_index] = *kin;
+    pl.previous_nominal_speed    = nominal_speed;
+    copyAxes(pl.previous_unit_vec, unit_vec);
+    copyAxes(pl.position, target_steps);
+    // The planned pointer may not stop at the last block, or its new entry speed would not be computed
+    if (block_buffer_planned == last_index) {
+        block_buffer_planned = plan_prev_block_index(last_index);
+    }
+    planner_update();
     return true;
 }
 
+// Gets the end of the newest block in motor space
+void plan_get_position(float* position) {
+    auto n_axis = Axes::_numberAxis;
+    for (size_t idx = 0; idx < n_axis; idx++) {
+        position[idx] = steps_to_mpos(pl.position[idx], idx);
+    }
+}
+
 // Reset the planner position vectors. Called by the system abort/initialization routine.
 void plan_sync_position() {
+    std::lock_guard<std::recursive_mutex> lock(Stepper::prep_mutex);
+
     // TODO: For motor configurations not in the same coordinate frame as the machine position,
     // this function needs to be updated to accomodate the difference.
     if (config->_axes) {
         get_motor_steps(pl.position);
     }
+    last_extendable = false;
+}
+
+// Returns the number of blocks in the planner buffer, which plan_init() may have cut down from planner_blocks
+uint32_t plan_get_block_buffer_size() {
+    return block_buffer_size;
 }
 
 // Returns the number of available blocks are in the planner buffer.
 // Called from report_realtime_status
-uint8_t plan_get_block_buffer_available() {
+uint32_t plan_get_block_buffer_available() {
     if (block_buffer_head >= block_buffer_tail) {
-        return (config->_planner_blocks - 1) - (block_buffer_head - block_buffer_tail);
+        return (block_buffer_size - 1) - (block_buffer_head - block_buffer_tail);
     } else {
         return block_buffer_tail - block_buffer_head - 1;
     }
@@ -450,6 +665,8 @@ uint8_t plan_get_block_buffer_available() {
 // Re-initialize buffer plan with a partially completed block, assumed to exist at the buffer tail.
 // Called after a steppers have come to a complete stop for a feed hold and the cycle is stopped.
 void plan_cycle_reinitialize() {
+    std::lock_guard<std::recursive_mutex> lock(Stepper::prep_mutex);
+
     // Re-plan from a complete stop. Reset planner entry speeds and buffer planned pointer.
     Stepper::update_plan_block_parameters();
     block_buffer_planned = block_buffer_tail;
@@ -24,6 +24,19 @@ struct PlMotion {
     uint8_t inverseTime : 1;     // Interprets feed rate value as inverse time when set.
 };
 
+// Fields used by the motion planner to manage acceleration. Some of these values may be updated
+// by the stepper module during execution of special motion cases for replanning purposes.
+// They are kept in an array parallel to the planner blocks, so that the passes of
+// planner_recalculate() stream through contiguous data instead of striding over whole blocks.
+struct plan_kinematics_t {
+    float entry_speed_sqr;      // The current planned entry speed at block junction in (mm/min)^2
+    float max_entry_speed_sqr;  // Maximum allowable entry speed based on the minimum of junction limit and
+    //   neighboring nominal speeds with overrides in (mm/min)^2
+    float acceleration;  // Axis-limit adjusted line acceleration in (mm/min^2). Does not change.
+    float millimeters;   // The remaining distance for this block to be executed in (mm).
+    // NOTE: This value may be altered by stepper algorithm during execution.
+};
+
 // This struct stores a linear movement of a g-code block motion with its critical "nominal" values
 // are as specified in the source g-code.
 struct plan_block_t {
@@ -40,14 +53,8 @@ struct plan_block_t {
     CoolantState coolant;      // Coolant state
     int32_t      line_number;  // Block line number for real-time reporting. Copied from pl_line_data.
 
-    // Fields used by the motion planner to manage acceleration. Some of these values may be updated
-    // by the stepper module during execution of special motion cases for replanning purposes.
-    float entry_speed_sqr;      // The current planned entry speed at block junction in (mm/min)^2
-    float max_entry_speed_sqr;  // Maximum allowable entry speed based on the minimum of junction limit and
-    //   neighboring nominal speeds with overrides in (mm/min)^2
-    float acceleration;  // Axis-limit adjusted line acceleration in (mm/min^2). Does not change.
-    float millimeters;   // The remaining distance for this block to be executed in (mm).
-    // NOTE: This value may be altered by stepper algorithm during execution.
+    // The fields that the motion planner uses to manage acceleration are in the
+    // block's plan_kinematics_t.  See plan_get_kinematics().
 
     // Stored rate limiting data used by planner when changes occur.
     float max_junction_speed_sqr;  // Junction entry speed limit based on direction vectors in (mm/min)^2
@@ -70,6 +77,7 @@ struct plan_line_data_t {
     int32_t      line_number;     // Desired line number to report when executing.
     bool         is_jog;          // true if this was generated due to a jog command
     bool         limits_checked;  // true if soft limits already checked
+    float        path_tolerance;  // G64 P tolerance for merging with the previous line, 0 for exact path
 };
 
 void plan_init();
@@ -84,6 +92,18 @@ void plan_reset_buffer();  // Reset buffer only.
 // Returns true on success.
 bool plan_buffer_line(float* target, plan_line_data_t* pl_data);
 
+// Replaces the newest block with a line from its start to target, so that two short lines become
+// one block. Returns false, leaving the buffer unchanged, if the newest block cannot be replaced.
+bool plan_extend_last_line(float* target, plan_line_data_t* pl_data);
+
+// Gets the end of the newest block in motor space
+void plan_get_position(float* position);
+
+// Between these calls, the plan is updated once for a run of lines instead of once per line.
+// The plan is also updated whenever the buffer fills.
+void plan_begin_batch();
+void plan_end_batch();
+
 // Called when the current block is no longer needed. Discards the block and makes the memory
 // availible for new blocks.
 void plan_discard_current_block();
@@ -94,8 +114,11 @@ plan_block_t* plan_get_system_motion_block();
 // Gets the current block. Returns NULL if buffer empty
 plan_block_t* plan_get_current_block();
 
+// Gets the acceleration management fields of a block
+plan_kinematics_t* plan_get_kinematics(const plan_block_t* block);
+
 // Increment block index with wrap-around
-static uint8_t plan_next_block_index(uint8_t block_index);
+static uint32_t plan_next_block_index(uint32_t block_index);
 
 // Called by step segment buffer when computing executing block velocity profile.
 float plan_get_exec_block_exit_speed_sqr();
@@ -103,6 +126,17 @@ float plan_get_exec_block_exit_speed_sqr();
 // Called by main program during planner calculations and step segment buffer during initialization.
 float plan_compute_profile_nominal_speed(plan_block_t* block);
 
+// Returns the time in minutes that a ramp takes to change speed by speed_change, accelerating
+// at no more than acceleration and, when s_curve_jerk is set, changing acceleration at no more
+// than the jerk.  With a jerk, each ramp starts and ends at zero acceleration.
+float plan_ramp_time(float speed_change, float acceleration);
+
+// Returns the distance that a ramp between two speeds covers
+float plan_ramp_distance(float speed_a, float speed_b, float acceleration);
+
+// Returns the square of the fastest speed that a ramp from sqrt(speed_sqr) can reach over millimeters
+float plan_reachable_speed_sqr(float speed_sqr, float acceleration, float millimeters);
+
 // Re-calculates buffered motions profile parameters upon a motion-based override change.
 void plan_update_velocity_profile_parameters();
 
@@ -112,10 +146,13 @@ void plan_sync_position();
 // Reinitialize plan with a partially completed block
 void plan_cycle_reinitialize();
 
+// Returns the number of blocks in the planner buffer, which may be fewer than planner_blocks
+uint32_t plan_get_block_buffer_size();
+
 // Returns the number of available blocks are in the planner buffer.
-uint8_t plan_get_block_buffer_available();
+uint32_t plan_get_block_buffer_available();
 
 // Returns the status of the block ring buffer. True, if buffer is full.
-uint8_t plan_check_full_buffer();
+bool plan_check_full_buffer();
 
 void plan_get_planner_mpos(float* target);
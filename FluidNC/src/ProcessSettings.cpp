@@ -20,8 +20,11 @@
 #include "UartChannel.h"          // Uart0.write()
 #include "FileStream.h"           // FileStream()
 #include "StartupLog.h"           // startupLog
+#include "Stepper.h"              // Stepper::underruns, Stepper::segment_depth()
+#include "IsrStats.h"             // IsrStats::report()
 #include "Driver/gpio_dump.h"     // gpio_dump()
 #include "FileCommands.h"         // make_file_commands()
+#include "GCodeBinary.h"          // GCodeBinary::format()
 
 #include "FluidPath.h"
 #include "HashFS.h"
@@ -898,6 +901,54 @@ static Error showHeap(const char* value, AuthenticationLevel auth_level, Channel
     return Error::Ok;
 }
 
+// Shows how many G-code lines were merged into longer planner blocks; $MS=Reset clears the counts
+static Error showMergeStats(const char* value, AuthenticationLevel auth_level, Channel& out) {
+    if (value) {
+        if (strcasecmp(value, "Reset") != 0) {
+            return Error::InvalidValue;
+        }
+        mc_lines_planned = 0;
+        mc_lines_merged  = 0;
+        return Error::Ok;
+    }
+    uint32_t blocks = mc_lines_planned - mc_lines_merged;
+    float    ratio  = blocks ? float(mc_lines_planned) / blocks : 1.0f;
+    log_info_to(out, "Lines: " << mc_lines_planned << " Blocks: " << blocks << " Merge ratio: " << setprecision(2) << ratio);
+    return Error::Ok;
+}
+
+static Error showStepperStats(const char* value, AuthenticationLevel auth_level, Channel& out) {
+    log_info_to(out, "Segment underruns: " << Stepper::underruns);
+    log_info_to(out, "Spindle updates skipped: " << Stepper::spindle_updates_skipped);
+    log_info_to(out, "Segment depth: " << Stepper::segment_depth() << " of " << Machine::Stepping::_segments);
+    return Error::Ok;
+}
+
+static Error isrStats(const char* value, AuthenticationLevel auth_level, Channel& out) {
+    if (!value) {
+        IsrStats::report(out);
+        return Error::Ok;
+    }
+    if (strcasecmp(value, "On") == 0) {
+        IsrStats::enable(false);
+        IsrStats::reset();
+        IsrStats::enable(true);
+        return Error::Ok;
+    }
+    if (strcasecmp(value, "Off") == 0) {
+        IsrStats::enable(false);
+        return Error::Ok;
+    }
+    if (strcasecmp(value, "Reset") == 0) {
+        bool was_enabled = IsrStats::enabled;
+        IsrStats::enable(false);
+        IsrStats::reset();
+        IsrStats::enable(was_enabled);
+        return Error::Ok;
+    }
+    return Error::InvalidValue;
+}
+
 // Commands use the same syntax as Settings, but instead of setting or
 // displaying a persistent value, a command causes some action to occur.
 // That action could be anything, from displaying a run-time parameter
@@ -953,6 +1004,9 @@ void make_user_commands() {
 
     new UserCommand("SA", "Alarm/Send", sendAlarm, anyState);
     new UserCommand("Heap", "Heap/Show", showHeap, anyState);
+    new UserCommand("MS", "Merge/Show", showMergeStats, anyState);
+    new UserCommand("STS", "Stepper/Stats", showStepperStats, anyState);
+    new UserCommand("ISR", "Stepper/ISR", isrStats, anyState);
     new UserCommand("SS", "Startup/Show", showStartupLog, anyState);
     new UserCommand("UP", "Uart/Passthrough", uartPassthrough, notIdleOrAlarm);
 
@@ -1172,3 +1226,22 @@ Error execute_line(char* line, Channel& channel, AuthenticationLevel auth_level)
     }
     return result;
 }
+
+// Executes a block from a precompiled job file, which is always G-code
+Error execute_words(const gc_word_t* words, int n_words, Channel& channel) {
+    // Blank lines are not blocks, so even a block that held only comments is locked out, as in execute_line()
+    if (state_is(State::Alarm) || state_is(State::ConfigAlarm) || state_is(State::Jog)) {
+        return Error::SystemGcLock;
+    }
+    // A block without words held only comments. For syncing purposes, like an empty line.
+    if (n_words == 0) {
+        return Error::Ok;
+    }
+    Error result = gc_execute_words(words, n_words);
+    if (result != Error::Ok && result != Error::Reset) {
+        char line[Channel::maxLine];
+        GCodeBinary::format(words, n_words, line, sizeof(line));
+        log_debug_to(channel, "Bad GCode: " << line);
+    }
+    return result;
+}
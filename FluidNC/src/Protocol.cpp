@@ -20,6 +20,8 @@
 #include "SettingsDefinitions.h"  // gcode_echo
 #include "Machine/LimitPin.h"
 #include "Job.h"
+#include "Estimator.h"
+#include "GCodeBinary.h"  // GCodeBinary::format()
 #include "Driver/restart.h"
 
 volatile ExecAlarm lastAlarm;  // The most recent alarm code
@@ -281,13 +283,19 @@ void protocol_main_loop() {
     // ---------------------------------------------------------------------------------
     for (;; vTaskDelay(0)) {
         if (activeChannel) {
-            // The input polling task has collected a line of input
+            // The input polling task has collected a line of input, or a block from a precompiled file
+            int              n_words;
+            const gc_word_t* words = activeChannel->preparsed(n_words);
             if (gcode_echo->get()) {
+                if (words) {
+                    GCodeBinary::format(words, n_words, activeLine, Channel::maxLine);
+                }
                 report_echo_line_received(activeLine, allChannels);
             }
 
             Channel* out_channel = Job::leader ? Job::leader : activeChannel;
-            Error    status_code = execute_line(activeLine, *out_channel, AuthenticationLevel::LEVEL_GUEST);
+            Error    status_code = words ? execute_words(words, n_words, *out_channel)
+                                         : execute_line(activeLine, *out_channel, AuthenticationLevel::LEVEL_GUEST);
 
             // Tell the channel that the line has been processed.
             // If the line was aborted, the channel could be invalid
@@ -348,6 +356,10 @@ void protocol_main_loop() {
 // Block until all buffered steps are executed or in a cycle state. Works with feed hold
 // during a synchronize call, if it should happen. Also, waits for clean cycle end.
 void protocol_buffer_synchronize() {
+    if (Estimator::active) {
+        Estimator::flush();  // Simulated motion completes immediately
+        return;
+    }
     do {
         // Restart motion if there are blocks in the planner queue
         protocol_auto_cycle_start();
@@ -497,6 +509,7 @@ static void protocol_do_alarm(void* alarmVoid) {
 }
 
 static void protocol_start_holding() {
+    std::lock_guard<std::recursive_mutex> lock(Stepper::prep_mutex);
     if (!(sys.suspend.bit.motionCancel || sys.suspend.bit.jogCancel)) {  // Block, if already holding.
         sys.step_control = {};
         Stepper::update_plan_block_parameters();
@@ -505,6 +518,7 @@ static void protocol_start_holding() {
 }
 
 static void protocol_cancel_jogging() {
+    std::lock_guard<std::recursive_mutex> lock(Stepper::prep_mutex);
     if (!(sys.suspend.bit.motionCancel || sys.suspend.bit.jogCancel)) {  // Block, if already holding.
         sys.step_control = {};
         Stepper::update_plan_block_parameters();
@@ -616,6 +630,7 @@ static void protocol_do_safety_door() {
         case State::SafetyDoor:
             if (!sys.suspend.bit.jogCancel && sys.suspend.bit.initiateRestore) {  // Actively restoring
                 // Set hold and reset appropriate control flags to restart parking sequence.
+                std::lock_guard<std::recursive_mutex> lock(Stepper::prep_mutex);
                 if (sys.step_control.executeSysMotion) {
                     Stepper::update_plan_block_parameters();  // Notify stepper module to recompute for hold deceleration.
                     sys.step_control                  = {};
@@ -687,6 +702,7 @@ void protocol_cancel_disable_steppers() {
 static void protocol_do_initiate_cycle() {
     // log_debug("protocol_do_initiate_cycle " << state_name());
     // Start cycle only if queued motions exist in planner buffer and the motion is not canceled.
+    std::lock_guard<std::recursive_mutex> lock(Stepper::prep_mutex);
     sys.step_control = {};  // Restore step control to normal operation
     plan_block_t* pb;
     if ((pb = plan_get_current_block()) && !sys.suspend.bit.motionCancel) {
@@ -701,6 +717,7 @@ static void protocol_do_initiate_cycle() {
 }
 static void protocol_initiate_homing_cycle() {
     // log_debug("protocol_initiate_homing_cycle " << state_name());
+    std::lock_guard<std::recursive_mutex> lock(Stepper::prep_mutex);
     sys.step_control                  = {};    // Restore step control to normal operation
     sys.suspend.value                 = 0;     // Break suspend state.
     sys.step_control.executeSysMotion = true;  // Set to execute homing motion and clear existing flags.
@@ -794,6 +811,7 @@ void protocol_do_cycle_stop() {
             if (!soft_limit && !sys.suspend.bit.jogCancel) {
                 // Hold complete. Set to indicate ready to resume.  Remain in HOLD or DOOR states until user
                 // has issued a resume command or reset.
+                std::lock_guard<std::recursive_mutex> lock(Stepper::prep_mutex);
                 plan_cycle_reinitialize();
                 if (sys.step_control.executeHold) {
                     sys.suspend.bit.holdComplete = true;
@@ -813,6 +831,7 @@ void protocol_do_cycle_stop() {
             // Motion complete. Includes CYCLE/JOG/HOMING states and jog cancel/motion cancel/soft limit events.
             // NOTE: Motion and jog cancel both immediately return to idle after the hold completes.
             if (sys.suspend.bit.jogCancel) {  // For jog cancel, flush buffers and sync positions.
+                std::lock_guard<std::recursive_mutex> lock(Stepper::prep_mutex);
                 sys.step_control = {};
                 plan_reset();
                 Stepper::reset();
@@ -859,6 +878,7 @@ static void protocol_do_late_reset() {
 }
 
 void protocol_exec_rt_system() {
+    // The handlers lock prep_mutex around the motion state changes that the prep task reads
     if (rtSafetyDoor) {
         protocol_do_safety_door();
     }
@@ -866,20 +886,8 @@ void protocol_exec_rt_system() {
     protocol_handle_events();
 
     // Reload step segment buffer
-    switch (sys.state) {
-        case State::ConfigAlarm:
-        case State::Alarm:
-        case State::CheckMode:
-        case State::Idle:
-        case State::Sleep:
-            break;
-        case State::Cycle:
-        case State::Hold:
-        case State::SafetyDoor:
-        case State::Homing:
-        case State::Jog:
-            Stepper::prep_buffer();
-            break;
+    if (Stepper::prep_state()) {
+        Stepper::prep_buffer();
     }
 }
 
@@ -903,6 +911,7 @@ static void protocol_manage_spindle() {
                 report_feedback_message(Message::SpindleRestore);
                 if (spindle->isRateAdjusted()) {
                     // When in laser mode, defer turn on until cycle starts
+                    std::lock_guard<std::recursive_mutex> lock(Stepper::prep_mutex);
                     sys.step_control.updateSpindleSpeed = true;
                 } else {
                     config->_parking->restore_spindle();
@@ -917,10 +926,15 @@ static void protocol_manage_spindle() {
     } else {
         // Handles spindle state during hold. NOTE: Spindle speed overrides may be altered during hold state.
         // NOTE: sys.step_control.updateSpindleSpeed is automatically reset upon resume in step generator.
-        if (sys.step_control.updateSpindleSpeed) {
-            config->_parking->restore_spindle();
+        bool update;
+        {
+            std::lock_guard<std::recursive_mutex> lock(Stepper::prep_mutex);
+            update                              = sys.step_control.updateSpindleSpeed;
             sys.step_control.updateSpindleSpeed = false;
         }
+        if (update) {
+            config->_parking->restore_spindle();
+        }
     }
 }
 
@@ -1042,8 +1056,11 @@ static void protocol_do_spindle_override(void* incrementvp) {
         }
     }
     if (percent != sys.spindle_speed_ovr) {
-        sys.spindle_speed_ovr               = percent;
-        sys.step_control.updateSpindleSpeed = true;
+        {
+            std::lock_guard<std::recursive_mutex> lock(Stepper::prep_mutex);
+            sys.spindle_speed_ovr               = percent;
+            sys.step_control.updateSpindleSpeed = true;
+        }
         gc_ovr_changed();
 
         // If spindle is on, tell it the RPM has been overridden
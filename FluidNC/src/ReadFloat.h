@@ -0,0 +1,14 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Read a floating point value from a string. Line points to the input buffer, pos
+// is the indexer pointing to the current character of the line, while float_ptr is
+// a pointer to the result variable. Returns true when it succeeds
+bool read_float(const char* line, size_t& pos, float& result);
+
+// The value intval * 10^exp, computed exactly as read_float() computes it
+float uint_to_float(uint32_t intval, int exp);
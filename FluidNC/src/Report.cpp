@@ -255,6 +255,12 @@ void report_gcode_modes(Channel& channel) {
         case Motion::CcwArc:
             msg << "G3";
             break;
+        case Motion::CubicSpline:
+            msg << "G5";
+            break;
+        case Motion::QuadraticSpline:
+            msg << "G5.1";
+            break;
         case Motion::ProbeToward:
             msg << "G38.2";
             break;
@@ -317,6 +323,15 @@ void report_gcode_modes(Channel& channel) {
             break;
     }
 
+    switch (gc_state.modal.control) {
+        case ControlMode::ExactPath:
+            msg << " G61";
+            break;
+        case ControlMode::Continuous:
+            msg << " G64";
+            break;
+    }
+
     //report_util_gcode_modes_M();
     switch (gc_state.modal.program_flow) {
         case ProgramFlow::Running:
@@ -15,12 +15,12 @@ std::vector<Setting*> Setting::List __attribute__((init_priority(101))) = {};
 std::vector<Command*> Command::List __attribute__((init_priority(102))) = {};
 
 bool get_param(const char* parameter, const char* key, std::string& s) {
-    char* start = strstr(parameter, key);
+    const char* start = strstr(parameter, key);
     if (!start) {
         return false;
     }
     s = "";
-    for (char* p = start + strlen(key); *p; ++p) {
+    for (const char* p = start + strlen(key); *p; ++p) {
         if (*p == ' ') {
             break;  // Unescaped space
         }
@@ -44,6 +44,9 @@ bool anyState() {
 bool notIdleOrJog() {
     return !state_is(State::Idle) && !state_is(State::Jog);
 }
+bool notIdle() {
+    return !state_is(State::Idle);
+}
 bool notIdleOrAlarm() {
     return !state_is(State::Idle) && !state_is(State::Alarm) && !state_is(State::ConfigAlarm) && !state_is(State::SafetyDoor);
 }
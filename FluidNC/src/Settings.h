@@ -7,6 +7,7 @@
 
 #include <string_view>
 #include <map>
+#include <functional>
 #include <nvs.h>
 #include <string_view>
 
@@ -348,6 +349,7 @@ public:
     int8_t get() { return _currentValue; }
 };
 
+extern bool notIdle();
 extern bool notIdleOrJog();
 extern bool notIdleOrAlarm();
 extern bool anyState();
@@ -423,5 +425,6 @@ public:
 Error settings_execute_line(char* line, Channel& out, AuthenticationLevel);
 Error do_command_or_setting(const char* key, const char* value, AuthenticationLevel auth_level, Channel&);
 Error execute_line(char* line, Channel& channel, AuthenticationLevel auth_level);
+Error execute_words(const gc_word_t* words, int n_words, Channel& channel);
 
 extern const enum_opt_t onoffOptions;
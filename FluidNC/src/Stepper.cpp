@@ -15,7 +15,12 @@
 #include "StepperPrivate.h"
 #include "Planner.h"
 #include "Protocol.h"
+#include "IsrStats.h"
+#include "Driver/delay_usecs.h"  // getCpuTicks()
 #include <esp_attr.h>  // IRAM_ATTR
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <atomic>
 #include <cmath>
 
 using namespace Stepper;
@@ -24,7 +29,7 @@ static bool awake = false;
 
 // Stores the planner block Bresenham algorithm execution data for the segments in the segment
 // buffer. Normally, this buffer is partially in-use, but, for the worst case scenario, it will
-// never exceed the number of accessible stepper buffer segments (Stepping::_segments-1).
+// never exceed the number of accessible stepper buffer segments (n_segments-1).
 // NOTE: This data is copied from the prepped planner blocks so that the planner blocks may be
 // discarded when entirely consumed and completed by the segment buffer. Also, AMASS alters this
 // data for its own use.
@@ -42,23 +47,100 @@ static volatile st_block_t* st_block_buffer = nullptr;
 // the planner, where the remaining planner block steps still can.
 struct segment_t {
     uint16_t     n_step;             // Number of step events to be executed for this segment
-    uint16_t     isrPeriod;          // Time to next ISR tick, in units of timer ticks
+    uint32_t     isrPeriod;          // Time to next ISR tick, in units of timer ticks
     uint8_t      st_block_index;     // Stepper block data index. Uses this information to execute this segment.
     uint8_t      amass_level;        // AMASS level for the ISR to execute this segment
     uint32_t     spindle_dev_speed;  // Spindle speed scaled to the device
     SpindleSpeed spindle_speed;      // Spindle speed in GCode units
+    uint32_t     start_ticks;        // Step timer ticks of all the segments prepped before this one
+    bool         spindle_changed;    // spindle_dev_speed differs from the previous segment's
+    int32_t      spindle_dev_step;   // Change of the device speed per ISR tick, with SPINDLE_FRACTION_BITS
 };
 static segment_t* segment_buffer = nullptr;
+static uint32_t   n_segments;     // Entries in segment_buffer
+static uint32_t   segment_ticks;  // Step timer ticks in DT_SEGMENT
+
+// Buffer depth, in segments of DT_SEGMENT, that prep_buffer() fills to.  It is the configured
+// number of segments unless stepping/auto_segments is set, in which case it follows the most
+// step time that has drained from the buffer between two refills.
+static uint32_t depth;
+static uint32_t exit_ahead;    // Time in the buffer when prep_buffer() last filled it
+static uint32_t worst_drain;   // Most time drained between refills since the last depth check
+static uint32_t window_ticks;  // Time drained since the last depth check
+
+// AMASS settings for the step engine, from Stepper::init()
+static uint32_t amass_threshold;  // Step timer ticks per step above which AMASS doubles the ISR rate
+static uint32_t amass_levels;     // Most times that AMASS doubles the ISR rate
+
+static const uint32_t min_depth     = 6;    // Smallest depth that auto_segments will choose
+static const uint32_t headroom      = 2;    // Multiple of the worst drain kept in the buffer
+static const uint32_t window_length = 100;  // Segments of drained time between checks for shrinking
+
+std::recursive_mutex Stepper::prep_mutex;
+volatile uint32_t    Stepper::underruns              = 0;
+volatile uint32_t    Stepper::spindle_updates_skipped = 0;
+
+bool Stepper::prep_state() {
+    switch (sys.state) {
+        case State::ConfigAlarm:
+        case State::Alarm:
+        case State::CheckMode:
+        case State::Idle:
+        case State::Sleep:
+            return false;
+        case State::Cycle:
+        case State::Hold:
+        case State::SafetyDoor:
+        case State::Homing:
+        case State::Jog:
+            return true;
+    }
+    return false;
+}
+
+// Keeps the segment buffer full even while the main loop is busy with channel
+// I/O or long commands.  It runs on the other core, beside the input polling
+// tasks, so the main loop's work never delays it.  prep_mutex keeps it out of
+// the planner and motion state while the main loop changes them.
+static void prep_task(void* unused) {
+    while (true) {
+        if (prep_state()) {
+            prep_buffer();
+        }
+        vTaskDelay(1);
+    }
+}
 
 void Stepper::init() {
+    static TaskHandle_t prepTask = nullptr;
+    if (Stepping::_prepTask && !prepTask) {
+        xTaskCreatePinnedToCore(prep_task,                    // task
+                                "prep",                       // name for task
+                                4096,                         // size of task stack
+                                NULL,                         // parameters
+                                3,                            // priority
+                                &prepTask,                    // task handle
+                                SUPPORT_TASK_CORE             // core
+        );
+    }
+
     if (st_block_buffer) {
         delete[] st_block_buffer;
     }
-    st_block_buffer = new st_block_t[Stepping::_segments - 1];
+    // Adaptive segments are half as long during ramps, so it takes twice as many of them
+    // to keep the same time in the buffer
+    n_segments    = Stepping::_adaptiveSegments ? 2 * Stepping::_segments : Stepping::_segments;
+    segment_ticks = uint32_t(DT_SEGMENT * 60 * Machine::Stepping::fStepperTimer);
+    depth         = Stepping::_segments;
+    st_block_buffer = new st_block_t[n_segments - 1];
     if (segment_buffer) {
         delete[] segment_buffer;
     }
-    segment_buffer = new segment_t[Stepping::_segments];
+    segment_buffer = new segment_t[n_segments];
+
+    uint32_t amass_cutoff = MAX(Stepping::maxPulsesPerSec() / AMASS_CUTOFF_DIVISOR, 1u);
+    amass_threshold       = Machine::Stepping::fStepperTimer / amass_cutoff;
+    amass_levels          = Stepping::_amassLevels;
 }
 
 // Stepper ISR data struct. Contains the running data for the main stepper ISR.
@@ -77,17 +159,26 @@ typedef struct {
     uint8_t              exec_block_index;  // Tracks the current st_block index. Change indicates new block.
     volatile st_block_t* exec_block;        // Pointer to the block data for the segment being executed
     volatile segment_t*  exec_segment;      // Pointer to the segment being executed
+    bool                 spindle_stale;     // The spindle may have been changed since the ISR last set it
+    int32_t              spindle_fixed;     // Interpolated device speed, with SPINDLE_FRACTION_BITS
+    int32_t              spindle_step;      // Change of spindle_fixed per ISR tick, 0 if not interpolating
+    uint32_t             spindle_dev;       // Device speed that the ISR last set
 } stepper_t;
 static stepper_t st;
 
-// Step segment ring buffer indices
-static volatile uint32_t segment_buffer_tail;
-static volatile uint32_t segment_buffer_head;
-static uint32_t          segment_next_head;
+// Step segment ring buffer indices.  The ring has a single producer, prep_buffer(), which owns
+// head, and a single consumer, the step ISR, which owns tail.  Each side publishes its index with
+// a release store after it is done with the segment, and acquires the other side's index before
+// looking at a segment, so a segment is always complete when the ISR sees it, and is never
+// overwritten while the ISR is still executing it.
+static std::atomic<uint32_t> segment_buffer_tail;
+static std::atomic<uint32_t> segment_buffer_head;
+static uint32_t              segment_next_head;
 
 // Pointers for the step segment being prepped from the planner buffer. Accessed only by the
 // main program. Pointers may be planning segments or planner blocks ahead of what being executed.
 static plan_block_t*        pl_block;       // Pointer to the planner block being prepped
+static plan_kinematics_t*   pl_kin;         // Pointer to the acceleration fields of pl_block
 static volatile st_block_t* st_prep_block;  // Pointer to the stepper block data being prepped
 
 // Segment preparation data struct. Contains all the necessary information to compute new segments
@@ -117,6 +208,32 @@ typedef struct {
 
     float        inv_rate;  // Used by PWM laser mode to speed up segment calculations.
     SpindleSpeed current_spindle_speed;
+    uint32_t     last_dev_speed;  // Device speed at the end of the last prepped segment
+    float        peak_speed;      // Fastest segment end speed since discard_segments() (mm/min)
+    uint32_t     queued_ticks;    // Step timer ticks of all the segments prepped since the reset
+
+    // Shaped ramp state, used when S-curves or input shapers are configured
+    bool  shaped;         // Ramps of the current profile are shaped
+    bool  shape_accel;    // The acceleration ramp gets the input shaper
+    bool  shape_decel;    // The deceleration ramp gets the input shaper
+    bool  ramp_kept;      // The profile was kept through a replan, with the exit speed of the old plan
+    float ramp_start_mm;  // Start of the ramp measured from end of block (mm)
+    float ramp_v0;        // Speed at start of ramp (mm/min)
+    float ramp_dv;        // Speed change over the ramp (mm/min)
+    float ramp_time;      // Time into the ramp at the end of the segment buffer (min)
+    float ramp_duration;  // Total ramp time (min)
+    float ramp_base;      // Duration of the unshaped ramp that each impulse contributes (min)
+    float ramp_tj;        // Duration of each of the two jerk phases of the unshaped ramp (min)
+    float ramp_accel;     // Signed peak acceleration of the unshaped ramp (mm/min^2)
+    int   ramp_impulses;  // Number of shaper impulses applied to this ramp
+
+    // Combined input shaper of the axes that move in the current block
+    AxisMask shaper_axes;
+    int      n_impulses;     // 0 until computed
+    float    shaper_length;  // Time of the last impulse (min)
+    float    shaper_delay;   // Amplitude-weighted mean impulse time (min)
+    float    impulse_amp[Machine::InputShaper::MAX_TRAIN_IMPULSES];
+    float    impulse_time[Machine::InputShaper::MAX_TRAIN_IMPULSES];  // (min)
 
 } st_prep_t;
 static st_prep_t prep;
@@ -192,8 +309,13 @@ uint32_t Stepper::isr_count;  // for debugging only
  * call to this method that might cause variation in the timing. The aim
  * is to keep pulse timing as regular as possible.
  * Returns true if step interrupts should continue
+ *
+ * The axis count and whether any axis has a second motor are template
+ * parameters so that the compiler can unroll the per-axis loops.
+ * select_pulse_func() picks the instance that matches the configuration.
  */
-bool IRAM_ATTR Stepper::pulse_func() {
+template <size_t n_axis, bool ganged>
+static bool IRAM_ATTR pulse_func_n() {
 #ifdef DEBUG_STEPPER_ISR
     isr_count++;
 #endif
@@ -201,17 +323,17 @@ bool IRAM_ATTR Stepper::pulse_func() {
     if (!awake) {
         return false;
     }
-    auto n_axis = Axes::_numberAxis;
 
-    Stepping::step(st.step_outbits, st.dir_outbits);
+    Stepping::step<n_axis, ganged>(st.step_outbits, st.dir_outbits);
     st.step_outbits = 0;
 
     // If there is no step segment, attempt to pop one from the stepper buffer
     if (st.exec_segment == NULL) {
         // Anything in the buffer? If so, load and initialize next step segment.
-        if (segment_buffer_head != segment_buffer_tail) {
+        uint32_t tail = segment_buffer_tail.load(std::memory_order_relaxed);
+        if (segment_buffer_head.load(std::memory_order_acquire) != tail) {
             // Initialize new step segment and load number of steps to execute
-            st.exec_segment = &segment_buffer[segment_buffer_tail];
+            st.exec_segment = &segment_buffer[tail];
             // Initialize step segment timing per step and load number of steps to execute.
             Stepping::setTimerPeriod(st.exec_segment->isrPeriod);
             st.step_count = st.exec_segment->n_step;  // NOTE: Can sometimes be zero when moving slow.
@@ -221,21 +343,38 @@ bool IRAM_ATTR Stepper::pulse_func() {
                 st.exec_block_index = st.exec_segment->st_block_index;
                 st.exec_block       = &st_block_buffer[st.exec_block_index];
                 // Initialize Bresenham line and distance counters
-                for (int axis = 0; axis < n_axis; axis++) {
+#pragma GCC unroll MAX_N_AXIS
+                for (size_t axis = 0; axis < n_axis; axis++) {
                     st.counter[axis] = st.exec_block->step_event_count >> 1;
                 }
             }
 
             st.dir_outbits = st.exec_block->direction_bits;
             // Adjust Bresenham axis increment counters according to AMASS level.
-            for (int axis = 0; axis < n_axis; axis++) {
+#pragma GCC unroll MAX_N_AXIS
+            for (size_t axis = 0; axis < n_axis; axis++) {
                 st.steps[axis] = st.exec_block->steps[axis] >> st.exec_segment->amass_level;
             }
             // Set real-time spindle output as segment is loaded, just prior to the first step.
-            spindle->setSpeedfromISR(st.exec_segment->spindle_dev_speed);
+            // Only changes need to be sent, except that the first segment after a stop must resync,
+            // as must one after an interpolated segment, whose last tick may have been rounded down.
+            if (st.exec_segment->spindle_changed || st.spindle_stale || st.spindle_step) {
+                spindle->setSpeedfromISR(st.exec_segment->spindle_dev_speed);
+                st.spindle_stale = false;
+            } else {
+                ++Stepper::spindle_updates_skipped;
+            }
+            st.spindle_dev   = st.exec_segment->spindle_dev_speed;
+            st.spindle_fixed = int32_t(st.spindle_dev) << SPINDLE_FRACTION_BITS;
+            st.spindle_step  = st.exec_segment->spindle_dev_step;
         } else {
             // Segment buffer empty. Shutdown.
-            stop_stepping();
+            if (pl_block != NULL && state_is(State::Cycle)) {
+                // prep_buffer() fell behind in the middle of a planner block
+                ++underruns;
+            }
+            Stepping::unstep<n_axis, ganged>();
+            st.step_outbits = 0;
             if (!state_is(State::Jog)) {  // added to prevent ... jog after probing crash
                 // Ensure pwm is set properly upon completion of rate-controlled motion.
                 if (st.exec_block != NULL && st.exec_block->is_pwm_rate_adjusted) {
@@ -245,37 +384,106 @@ bool IRAM_ATTR Stepper::pulse_func() {
 
             protocol_send_event_from_ISR(&cycleStopEvent);
             awake = false;
-            Stepping::unstep();
+            Stepping::unstep<n_axis, ganged>();
             return false;  // Nothing to do but exit.
         }
     }
 
-    for (int axis = 0; axis < n_axis; axis++) {
+    auto step_event_count = st.exec_block->step_event_count;
+#pragma GCC unroll MAX_N_AXIS
+    for (size_t axis = 0; axis < n_axis; axis++) {
         // Execute step displacement profile by Bresenham line algorithm
         st.counter[axis] += st.steps[axis];
-        if (st.counter[axis] > st.exec_block->step_event_count) {
+        if (st.counter[axis] > step_event_count) {
             set_bitnum(st.step_outbits, axis);
-            st.counter[axis] -= st.exec_block->step_event_count;
+            st.counter[axis] -= step_event_count;
+        }
+    }
+
+    if (st.spindle_step) {
+        // Ramp the laser power across the segment
+        st.spindle_fixed += st.spindle_step;
+        uint32_t dev = uint32_t(st.spindle_fixed) >> SPINDLE_FRACTION_BITS;
+        if (dev != st.spindle_dev) {
+            st.spindle_dev = dev;
+            spindle->setSpeedfromISR(dev);
         }
     }
 
     st.step_count--;  // Decrement step events count
     if (st.step_count == 0) {
         // Segment is complete. Discard current segment and advance segment indexing.
-        st.exec_segment     = NULL;
-        segment_buffer_tail = segment_buffer_tail >= (Stepping::_segments - 1) ? 0 : segment_buffer_tail + 1;
+        uint32_t tail   = segment_buffer_tail.load(std::memory_order_relaxed);
+        st.exec_segment = NULL;
+        segment_buffer_tail.store(tail >= (n_segments - 1) ? 0 : tail + 1, std::memory_order_release);
     }
 
-    Stepping::unstep();
+    Stepping::unstep<n_axis, ganged>();
     return true;
 }
 
+// Indexed by axis count - 1 and whether any axis is ganged
+static_assert(MAX_N_AXIS == 6, "pulse_funcs needs an entry for each axis count");
+static bool (*const pulse_funcs[MAX_N_AXIS][2])() = {
+    { pulse_func_n<1, false>, pulse_func_n<1, true> }, { pulse_func_n<2, false>, pulse_func_n<2, true> },
+    { pulse_func_n<3, false>, pulse_func_n<3, true> }, { pulse_func_n<4, false>, pulse_func_n<4, true> },
+    { pulse_func_n<5, false>, pulse_func_n<5, true> }, { pulse_func_n<6, false>, pulse_func_n<6, true> },
+};
+
+// Handles every configuration until select_pulse_func() is called
+static bool (*pulse_variant)() = pulse_func_n<MAX_N_AXIS, true>;
+
+void Stepper::select_pulse_func() {
+    size_t n_axis = Axes::_numberAxis;
+    pulse_variant = n_axis ? pulse_funcs[n_axis - 1][Stepping::ganged()] : pulse_func_n<MAX_N_AXIS, true>;
+}
+
+// pulse_func() with the IsrStats measurements around it
+static bool IRAM_ATTR pulse_func_measured() {
+    static int32_t  last_start;   // CPU time of the previous call
+    static uint32_t last_period;  // Step timer period since the previous call, 0 after a stop
+
+    int32_t start = getCpuTicks();
+    if (IsrStats::calls && last_period) {
+        int32_t late = (start - last_start) - int32_t(last_period * IsrStats::cpu_per_tick);
+        IsrStats::jitter.add(late < 0 ? -late : late);
+    }
+    if (st.exec_segment == NULL) {
+        uint32_t tail   = segment_buffer_tail.load(std::memory_order_relaxed);
+        uint32_t head   = segment_buffer_head.load(std::memory_order_relaxed);
+        uint32_t queued = head >= tail ? head - tail : head + n_segments - tail;
+        ++IsrStats::fill[queued < IsrStats::max_fill ? queued : IsrStats::max_fill];
+    }
+
+    bool more = pulse_variant();
+
+    IsrStats::cycles.add(getCpuTicks() - start);
+    ++IsrStats::calls;
+    last_start = start;
+    if (!more) {
+        last_period = 0;
+    } else if (st.exec_segment) {
+        // The timer keeps this period until the next segment is loaded
+        last_period = st.exec_segment->isrPeriod;
+    }
+    return more;
+}
+
+bool IRAM_ATTR Stepper::pulse_func() {
+    if (IsrStats::enabled) {
+        return pulse_func_measured();
+    }
+    return pulse_variant();
+}
+
 // enabled. Startup init and limits call this function but shouldn't start the cycle.
 void Stepper::wake_up() {
     if (awake) {
         return;
     }
     awake = true;
+    // The spindle can be set by the main program while stepping is stopped
+    st.spindle_stale = true;
     // Cancel any pending stepper disable
     protocol_cancel_disable_steppers();
     // Enable stepper drivers.
@@ -293,6 +501,8 @@ void Stepper::go_idle() {
 
 // Reset and clear stepper subsystem variables
 void Stepper::reset() {
+    std::lock_guard<std::recursive_mutex> lock(prep_mutex);
+
     // Initialize Stepping driver idle state.
     Stepping::reset();
 
@@ -303,19 +513,30 @@ void Stepper::reset() {
     memset(&st, 0, sizeof(stepper_t));
     st.exec_segment     = NULL;
     pl_block            = NULL;  // Planner block pointer used by segment buffer
-    segment_buffer_tail = 0;
-    segment_buffer_head = 0;  // empty = tail
-    segment_next_head   = 1;
-    st.step_outbits     = 0;
-    st.dir_outbits      = 0;  // Initialize direction bits to default.
+    segment_buffer_tail.store(0);
+    segment_buffer_head.store(0);  // empty = tail
+    segment_next_head = 1;
+    exit_ahead        = 0;
+    st.step_outbits   = 0;
+    st.dir_outbits    = 0;  // Initialize direction bits to default.
     // TODO do we need to turn step pins off?
 }
 
 // Called by planner_recalculate() when the executing block is updated by the new plan.
-bool Stepper::update_plan_block_parameters() {
+bool Stepper::update_plan_block_parameters(bool keepRamp) {
+    std::lock_guard<std::recursive_mutex> lock(prep_mutex);
+
+    if (keepRamp && pl_block != NULL && prep.shaped && prep.ramp_time > 0.0f &&
+        (prep.ramp_type == RAMP_ACCEL || prep.ramp_type == RAMP_DECEL)) {
+        // The block keeps its profile. Planning it as entering at the exit speed of that profile
+        // keeps the planner from slowing the next block below it.
+        pl_kin->entry_speed_sqr = prep.exit_speed * prep.exit_speed;
+        prep.ramp_kept          = true;
+        return false;
+    }
     if (pl_block != NULL) {  // Ignore if at start of a new block.
         prep.recalculate_flag.recalculate = 1;
-        pl_block->entry_speed_sqr         = prep.current_speed * prep.current_speed;  // Update entry speed.
+        pl_kin->entry_speed_sqr           = prep.current_speed * prep.current_speed;  // Update entry speed.
         pl_block                          = NULL;  // Flag prep_segment() to load and check active velocity profile.
         return true;
     }
@@ -324,6 +545,8 @@ bool Stepper::update_plan_block_parameters() {
 
 // Changes the run state of the step segment buffer to execute the special parking motion.
 void Stepper::parking_setup_buffer() {
+    std::lock_guard<std::recursive_mutex> lock(prep_mutex);
+
     // Store step execution data of partially completed block, if necessary.
     if (prep.recalculate_flag.holdPartialBlock) {
         prep.last_st_block_index  = prep.st_block_index;
@@ -339,6 +562,8 @@ void Stepper::parking_setup_buffer() {
 
 // Restores the step segment buffer to the normal run state after a parking motion.
 void Stepper::parking_restore_buffer() {
+    std::lock_guard<std::recursive_mutex> lock(prep_mutex);
+
     // Restore step execution data and flags of partially completed block, if necessary.
     if (prep.recalculate_flag.holdPartialBlock) {
         st_prep_block                          = &st_block_buffer[prep.last_st_block_index];
@@ -359,7 +584,214 @@ void Stepper::parking_restore_buffer() {
 // Increments the step segment buffer block data ring buffer.
 static uint8_t next_block_index(uint8_t block_index) {
     block_index++;
-    return block_index == (Stepping::_segments - 1) ? 0 : block_index;
+    return block_index == (n_segments - 1) ? 0 : block_index;
+}
+
+/* Shaped velocity ramps
+
+   An S-curve ramp has three phases: the acceleration grows linearly with the jerk, stays
+   constant at the block's acceleration, and then falls linearly back to zero. Together with
+   the cruise phase, the accelerating and decelerating ramps of a block make up the 7-phase
+   profile. A ramp whose speed change is too small to reach the block's acceleration becomes a
+   pure S. Either way the ramp is longer than a constant-acceleration one, so the planner plans
+   the junction speeds with the same ramp lengths (plan_reachable_speed_sqr()). The
+   acceleration is zero at every block junction, so a low jerk slows runs of short blocks.
+
+   An input shaper convolves that ramp with a train of impulses, so the ramp becomes a sum of
+   smaller, delayed copies of itself whose ringing cancels. The copies keep the ramp's
+   acceleration, so the shaped ramp is longer by the length of the train, and the distance that
+   adds is taken from the cruise of the block. The shaper state is not carried across blocks,
+   so a ramp is left unshaped when its block has too little cruise for it. That leaves triangle
+   blocks and the short blocks of dense paths unshaped.
+*/
+
+// Whether the ramps of the current block are shaped. Feed holds and override decelerations
+// keep constant-deceleration ramps.
+static bool shaped_ramps() {
+    return config->_sCurveJerk > 0.0f || prep.n_impulses > 1;
+}
+
+// Combines the input shapers of the axes in axes into one impulse train by convolution
+static void shaper_setup(AxisMask axes) {
+    prep.shaper_axes     = axes;
+    prep.n_impulses      = 1;
+    prep.impulse_amp[0]  = 1.0f;
+    prep.impulse_time[0] = 0.0f;
+
+    auto n_axis = Axes::_numberAxis;
+    for (size_t axis = 0; axis < n_axis; axis++) {
+        auto shaper = Axes::_axis[axis]->_shaper;
+        if (!bitnum_is_true(axes, axis) || !shaper || shaper->_type == Machine::InputShaper::None) {
+            continue;
+        }
+        float amp[Machine::InputShaper::MAX_IMPULSES];
+        float time[Machine::InputShaper::MAX_IMPULSES];
+        int   n = shaper->impulses(amp, time);
+        if (prep.n_impulses * n > Machine::InputShaper::MAX_TRAIN_IMPULSES) {
+            continue;  // Logged by Axes::init()
+        }
+        float old_amp[Machine::InputShaper::MAX_TRAIN_IMPULSES];
+        float old_time[Machine::InputShaper::MAX_TRAIN_IMPULSES];
+        int   old_n = prep.n_impulses;
+        memcpy(old_amp, prep.impulse_amp, sizeof(old_amp));
+        memcpy(old_time, prep.impulse_time, sizeof(old_time));
+        prep.n_impulses = 0;
+        for (int i = 0; i < old_n; i++) {
+            for (int j = 0; j < n; j++) {
+                prep.impulse_amp[prep.n_impulses]  = old_amp[i] * amp[j];
+                prep.impulse_time[prep.n_impulses] = old_time[i] + time[j] / 60.0f;  // sec to min
+                prep.n_impulses++;
+            }
+        }
+    }
+
+    prep.shaper_length = 0.0f;
+    prep.shaper_delay  = 0.0f;
+    for (int i = 0; i < prep.n_impulses; i++) {
+        prep.shaper_length = MAX(prep.shaper_length, prep.impulse_time[i]);
+        prep.shaper_delay += prep.impulse_amp[i] * prep.impulse_time[i];
+    }
+}
+
+static void ramp_start(float v0, float v1, float start_mm, bool shape) {
+    prep.ramp_start_mm = start_mm;
+    prep.ramp_v0       = v0;
+    prep.ramp_dv       = v1 - v0;
+    prep.ramp_time     = 0.0f;
+    prep.ramp_impulses = shape ? prep.n_impulses : 1;
+
+    float accel        = pl_kin->acceleration;
+    float Tb           = plan_ramp_time(fabsf(prep.ramp_dv), accel);
+    prep.ramp_base     = Tb;
+    prep.ramp_duration = shape ? Tb + prep.shaper_length : Tb;
+
+    float jerk = config->_sCurveJerk * (60.0f * 60.0f * 60.0f);  // mm/sec^3 to mm/min^3
+    // The jerk phases last as long as the jerk takes to reach the block's acceleration, or half
+    // of a pure S ramp
+    prep.ramp_tj    = jerk > 0.0f ? MIN(accel / jerk, 0.5f * Tb) : 0.0f;
+    prep.ramp_accel = Tb > 0.0f ? prep.ramp_dv / (Tb - prep.ramp_tj) : 0.0f;
+}
+
+// Computes the profile of the block with shaped ramps. The entry speed may be slower than
+// planned, so the planned exit speed is lowered to one that the block can reach.
+static void shaped_profile(float nominal_speed) {
+    float mm    = pl_kin->millimeters;
+    float accel = pl_kin->acceleration;
+    float v0    = prep.current_speed;
+    float v1    = MIN(prep.exit_speed, sqrtf(plan_reachable_speed_sqr(v0 * v0, accel, mm)));
+    float peak  = MAX(nominal_speed, v1);
+    float up    = plan_ramp_distance(v0, peak, accel);
+    float down  = plan_ramp_distance(peak, v1, accel);
+    if (up + down > mm) {
+        // Triangle type. Bisect for the fastest peak whose ramps fit in the block.
+        float lo = MAX(v0, v1);
+        float hi = peak;
+        for (int i = 0; i < 16; i++) {
+            float mid = 0.5f * (lo + hi);
+            if (plan_ramp_distance(v0, mid, accel) + plan_ramp_distance(mid, v1, accel) > mm) {
+                hi = mid;
+            } else {
+                lo = mid;
+            }
+        }
+        peak = lo;
+        up   = plan_ramp_distance(v0, peak, accel);
+        down = MIN(plan_ramp_distance(peak, v1, accel), mm);
+    }
+
+    // The impulse train lengthens a shaped ramp by shaper_length, during which it covers the
+    // distance of that much time at its end speed, less what the mean impulse delay holds back
+    prep.shape_accel = false;
+    prep.shape_decel = false;
+    if (prep.n_impulses > 1) {
+        float cruise = mm - up - down;
+        float extra  = peak * prep.shaper_length - (peak - v0) * prep.shaper_delay;
+        if (peak > v0 && extra <= cruise) {
+            prep.shape_accel = true;
+            up += extra;
+            cruise -= extra;
+        }
+        extra = v1 * prep.shaper_length + (peak - v1) * prep.shaper_delay;
+        if (peak > v1 && extra <= cruise) {
+            prep.shape_decel = true;
+            down += extra;
+        }
+    }
+    prep.exit_speed       = v1;
+    prep.maximum_speed    = peak;
+    prep.accelerate_until = MAX(mm - up, 0.0f);
+    prep.decelerate_after = down;
+    if (peak > v0) {
+        prep.ramp_type = RAMP_ACCEL;
+        ramp_start(v0, peak, mm, prep.shape_accel);
+    } else if (down < mm) {
+        prep.ramp_type = RAMP_CRUISE;
+    } else {
+        prep.ramp_type = RAMP_DECEL;
+        ramp_start(v0, v1, mm, prep.shape_decel);
+    }
+}
+
+// Returns the speed change at time t into the unshaped ramp, and the distance it adds by then
+static float ramp_base_at(float t, float& mm) {
+    float tj = prep.ramp_tj;
+    float a  = prep.ramp_accel;
+    float Tb = prep.ramp_base;
+    if (t >= Tb) {  // Past the end
+        mm = prep.ramp_dv * (t - 0.5f * Tb);
+        return prep.ramp_dv;
+    }
+    if (t < tj) {  // Rising acceleration
+        mm = a * t * t * t / (6.0f * tj);
+        return 0.5f * a * t * t / tj;
+    }
+    if (t <= Tb - tj) {  // Constant acceleration
+        mm = a * (t * t / 2.0f - t * tj / 2.0f + tj * tj / 6.0f);
+        return a * (t - 0.5f * tj);
+    }
+    // Falling acceleration, mirroring the rising phase from the end of the ramp
+    float r = Tb - t;
+    mm      = prep.ramp_dv * (t - 0.5f * Tb) + a * r * r * r / (6.0f * tj);
+    return prep.ramp_dv - 0.5f * a * r * r / tj;
+}
+
+// Returns the speed at time t into the ramp, and the distance covered by then
+static float ramp_at(float t, float& mm) {
+    float speed = prep.ramp_v0;
+    mm          = prep.ramp_v0 * t;
+    if (prep.ramp_impulses == 1) {
+        float base_mm;
+        speed += ramp_base_at(t, base_mm);
+        mm += base_mm;
+        return speed;
+    }
+    for (int i = 0; i < prep.ramp_impulses; i++) {
+        float u = t - prep.impulse_time[i];
+        if (u > 0.0f) {
+            float base_mm;
+            speed += prep.impulse_amp[i] * ramp_base_at(u, base_mm);
+            mm += prep.impulse_amp[i] * base_mm;
+        }
+    }
+    return speed;
+}
+
+// Advances the ramp by time_var. If the ramp ends within that time, returns true with
+// time_var reduced to the time left in the ramp; the caller finishes the ramp.
+static bool ramp_advance(float& time_var, float& mm_remaining, float end_mm) {
+    float t = prep.ramp_time + time_var;
+    if (t < prep.ramp_duration) {
+        float mm;
+        float speed = ramp_at(t, mm);
+        if (prep.ramp_start_mm - mm > end_mm) {
+            prep.ramp_time     = t;
+            prep.current_speed = speed;
+            mm_remaining       = prep.ramp_start_mm - mm;
+            return false;
+        }
+    }
+    time_var = prep.ramp_duration - prep.ramp_time;
+    return true;
 }
 
 /* Prepares step segment buffer. Continuously called from main program.
@@ -375,13 +807,103 @@ static uint8_t next_block_index(uint8_t block_index) {
    Currently, the segment buffer conservatively holds roughly up to 40-50 msec of steps.
    NOTE: Computation units are in steps, millimeters, and minutes.
 */
+// Returns the time in the segment buffer, in step timer ticks, of the segments queued behind
+// the one at the tail.  The ISR may be partway through that one, so it is left out rather
+// than counted whole, and the buffer is never reported as fuller than it is.
+static uint32_t time_ahead() {
+    uint32_t tail = segment_buffer_tail.load(std::memory_order_acquire);
+    uint32_t head = segment_buffer_head.load(std::memory_order_relaxed);
+    if (tail == head) {
+        return 0;
+    }
+    tail = tail >= (n_segments - 1) ? 0 : tail + 1;
+    if (tail == head) {
+        return 0;
+    }
+    return prep.queued_ticks - segment_buffer[tail].start_ticks;
+}
+
+// Whether the segment buffer is below the current depth
+static bool buffer_has_room() {
+    uint32_t tail = segment_buffer_tail.load(std::memory_order_acquire);
+    if (tail == segment_next_head) {
+        return false;
+    }
+    if (Stepping::_adaptiveSegments) {
+        // Adaptive segments vary in length, so the depth is measured in time
+        return time_ahead() < (depth - 1) * segment_ticks;
+    }
+    uint32_t head = segment_buffer_head.load(std::memory_order_relaxed);
+    return (head >= tail ? head - tail : head + n_segments - tail) < depth - 1;
+}
+
+// Measures how much step time the ISR took from the buffer since it was last filled,
+// and resizes the buffer to hold headroom times the worst of those drains.  The depth
+// grows as soon as a drain needs it, and shrinks by one segment when a window of motion
+// has passed without needing the current depth.
+static void adjust_depth() {
+    uint32_t ahead = time_ahead();
+    if (exit_ahead == 0) {
+        // The buffer was not left full, so there was no refill deadline to measure
+        return;
+    }
+    uint32_t drained = exit_ahead > ahead ? exit_ahead - ahead : 0;
+    exit_ahead       = 0;
+
+    uint32_t needed;
+    if (ahead == 0) {
+        if (pl_block == NULL) {
+            // The motion ended, rather than the refill being late
+            return;
+        }
+        // The buffer ran dry, so the drain could have been even longer
+        needed = Stepping::_segments;
+    } else {
+        worst_drain = MAX(worst_drain, drained);
+        needed      = (headroom * worst_drain + segment_ticks - 1) / segment_ticks + 1;
+    }
+    needed = MIN(MAX(needed, min_depth), Stepping::_segments);
+
+    window_ticks += drained;
+    if (needed > depth) {
+        depth        = needed;
+        window_ticks = 0;
+        worst_drain  = 0;
+    } else if (window_ticks >= window_length * segment_ticks) {
+        if (needed < depth) {
+            --depth;
+        }
+        window_ticks = 0;
+        worst_drain  = 0;
+    }
+}
+
+uint32_t Stepper::segment_depth() {
+    return depth;
+}
+
 void Stepper::prep_buffer() {
+    std::lock_guard<std::recursive_mutex> lock(prep_mutex);
+
     // Block step prep buffer, while in a suspend state and there is no suspend motion to execute.
     if (sys.step_control.endMotion) {
         return;
     }
 
-    while (segment_buffer_tail != segment_next_head) {  // Check if we need to fill the buffer.
+    if (Stepping::_autoSegments) {
+        adjust_depth();
+    }
+
+    // Check if we need to fill the buffer.
+    while (buffer_has_room()) {
+        // A ramp kept through a replan still aims at the exit speed of the old plan.  If the new
+        // plan exits slower, reaching the old target would force a speed step into the next block,
+        // so the profile is recomputed from the current speed instead.
+        if (pl_block != NULL && prep.ramp_kept && plan_get_exec_block_exit_speed_sqr() < prep.exit_speed * prep.exit_speed) {
+            prep.recalculate_flag.recalculate = 1;
+            pl_kin->entry_speed_sqr           = prep.current_speed * prep.current_speed;
+            pl_block                          = NULL;
+        }
         // Determine if we need to load a new planner block or if the block needs to be recomputed.
         if (pl_block == NULL) {
             // Query planner for a queued block
@@ -394,6 +916,7 @@ void Stepper::prep_buffer() {
             if (pl_block == NULL) {
                 return;  // No planner blocks. Exit.
             }
+            pl_kin = plan_get_kinematics(pl_block);
 
             // Check if we need to only recompute the velocity profile or load a new block.
             if (prep.recalculate_flag.recalculate) {
@@ -417,22 +940,36 @@ void Stepper::prep_buffer() {
                 // we never divide beyond the original data anywhere in the algorithm.
                 // If the original data is divided, we can lose a step from integer roundoff.
                 for (idx = 0; idx < n_axis; idx++) {
-                    st_prep_block->steps[idx] = pl_block->steps[idx] << maxAmassLevel;
+                    st_prep_block->steps[idx] = pl_block->steps[idx] << amass_levels;
+                }
+                st_prep_block->step_event_count = pl_block->step_event_count << amass_levels;
+
+                AxisMask moving = 0;
+                for (idx = 0; idx < n_axis; idx++) {
+                    if (pl_block->steps[idx]) {
+                        set_bitnum(moving, idx);
+                    }
+                }
+                if (moving != prep.shaper_axes || prep.n_impulses == 0) {
+                    shaper_setup(moving);
                 }
-                st_prep_block->step_event_count = pl_block->step_event_count << maxAmassLevel;
 
                 // Initialize segment buffer data for generating the segments.
                 prep.steps_remaining  = (float)pl_block->step_event_count;
-                prep.step_per_mm      = prep.steps_remaining / pl_block->millimeters;
+                prep.step_per_mm      = prep.steps_remaining / pl_kin->millimeters;
                 prep.req_mm_increment = REQ_MM_INCREMENT_SCALAR / prep.step_per_mm;
                 prep.dt_remainder     = 0.0;  // Reset for new segment block
                 if ((sys.step_control.executeHold) || prep.recalculate_flag.decelOverride) {
                     // New block loaded mid-hold. Override planner block entry speed to enforce deceleration.
                     prep.current_speed                  = prep.exit_speed;
-                    pl_block->entry_speed_sqr           = prep.exit_speed * prep.exit_speed;
+                    pl_kin->entry_speed_sqr             = prep.exit_speed * prep.exit_speed;
                     prep.recalculate_flag.decelOverride = 0;
+                } else if (shaped_ramps() && prep.current_speed * prep.current_speed < pl_kin->entry_speed_sqr) {
+                    // The last block ended slower than planned, because its exit speed was raised
+                    // during a ramp, so this one starts from the speed that was reached
+                    pl_kin->entry_speed_sqr = prep.current_speed * prep.current_speed;
                 } else {
-                    prep.current_speed = sqrtf(pl_block->entry_speed_sqr);
+                    prep.current_speed = sqrtf(pl_kin->entry_speed_sqr);
                 }
 
                 // prep.inv_rate is only used if is_pwm_rate_adjusted is true
@@ -453,16 +990,18 @@ void Stepper::prep_buffer() {
              hold, override the planner velocities and decelerate to the target exit speed.
             */
             prep.mm_complete  = 0.0;  // Default velocity profile complete at 0.0mm from end of block.
-            float inv_2_accel = 0.5f / pl_block->acceleration;
+            float inv_2_accel = 0.5f / pl_kin->acceleration;
+            prep.shaped       = false;
+            prep.ramp_kept    = false;
             if (sys.step_control.executeHold) {  // [Forced Deceleration to Zero Velocity]
                 // Compute velocity profile parameters for a feed hold in-progress. This profile overrides
                 // the planner block profile, enforcing a deceleration to zero speed.
                 prep.ramp_type = RAMP_DECEL;
                 // Compute decelerate distance relative to end of block.
-                float decel_dist = pl_block->millimeters - inv_2_accel * pl_block->entry_speed_sqr;
+                float decel_dist = pl_kin->millimeters - inv_2_accel * pl_kin->entry_speed_sqr;
                 if (decel_dist < 0.0) {
                     // Deceleration through entire planner block. End of feed hold is not in this block.
-                    prep.exit_speed = sqrtf(pl_block->entry_speed_sqr - 2 * pl_block->acceleration * pl_block->millimeters);
+                    prep.exit_speed = sqrtf(pl_kin->entry_speed_sqr - 2 * pl_kin->acceleration * pl_kin->millimeters);
                 } else {
                     prep.mm_complete = decel_dist;  // End of feed hold.
                     prep.exit_speed  = 0.0;
@@ -470,7 +1009,7 @@ void Stepper::prep_buffer() {
             } else {  // [Normal Operation]
                 // Compute or recompute velocity profile parameters of the prepped planner block.
                 prep.ramp_type        = RAMP_ACCEL;  // Initialize as acceleration ramp.
-                prep.accelerate_until = pl_block->millimeters;
+                prep.accelerate_until = pl_kin->millimeters;
                 float exit_speed_sqr;
                 float nominal_speed;
                 if (sys.step_control.executeSysMotion) {
@@ -482,15 +1021,15 @@ void Stepper::prep_buffer() {
 
                 nominal_speed            = plan_compute_profile_nominal_speed(pl_block);
                 float nominal_speed_sqr  = nominal_speed * nominal_speed;
-                float intersect_distance = 0.5f * (pl_block->millimeters + inv_2_accel * (pl_block->entry_speed_sqr - exit_speed_sqr));
-                if (pl_block->entry_speed_sqr > nominal_speed_sqr) {  // Only occurs during override reductions.
-                    prep.accelerate_until = pl_block->millimeters - inv_2_accel * (pl_block->entry_speed_sqr - nominal_speed_sqr);
+                float intersect_distance = 0.5f * (pl_kin->millimeters + inv_2_accel * (pl_kin->entry_speed_sqr - exit_speed_sqr));
+                if (pl_kin->entry_speed_sqr > nominal_speed_sqr) {  // Only occurs during override reductions.
+                    prep.accelerate_until = pl_kin->millimeters - inv_2_accel * (pl_kin->entry_speed_sqr - nominal_speed_sqr);
                     if (prep.accelerate_until <= 0.0) {  // Deceleration-only.
                         prep.ramp_type = RAMP_DECEL;
-                        // prep.decelerate_after = pl_block->millimeters;
+                        // prep.decelerate_after = pl_kin->millimeters;
                         // prep.maximum_speed = prep.current_speed;
                         // Compute override block exit speed since it doesn't match the planner exit speed.
-                        prep.exit_speed = sqrtf(pl_block->entry_speed_sqr - 2 * pl_block->acceleration * pl_block->millimeters);
+                        prep.exit_speed = sqrtf(pl_kin->entry_speed_sqr - 2 * pl_kin->acceleration * pl_kin->millimeters);
                         prep.recalculate_flag.decelOverride = 1;  // Flag to load next block as deceleration override.
                         // TODO: Determine correct handling of parameters in deceleration-only.
                         // Can be tricky since entry speed will be current speed, as in feed holds.
@@ -501,27 +1040,30 @@ void Stepper::prep_buffer() {
                         prep.maximum_speed    = nominal_speed;
                         prep.ramp_type        = RAMP_DECEL_OVERRIDE;
                     }
+                } else if (shaped_ramps()) {
+                    prep.shaped = true;
+                    shaped_profile(nominal_speed);
                 } else if (intersect_distance > 0.0) {
-                    if (intersect_distance < pl_block->millimeters) {  // Either trapezoid or triangle types
+                    if (intersect_distance < pl_kin->millimeters) {  // Either trapezoid or triangle types
                         // NOTE: For acceleration-cruise and cruise-only types, following calculation will be 0.0.
                         prep.decelerate_after = inv_2_accel * (nominal_speed_sqr - exit_speed_sqr);
                         if (prep.decelerate_after < intersect_distance) {  // Trapezoid type
                             prep.maximum_speed = nominal_speed;
-                            if (pl_block->entry_speed_sqr == nominal_speed_sqr) {
+                            if (pl_kin->entry_speed_sqr == nominal_speed_sqr) {
                                 // Cruise-deceleration or cruise-only type.
                                 prep.ramp_type = RAMP_CRUISE;
                             } else {
                                 // Full-trapezoid or acceleration-cruise types
-                                prep.accelerate_until -= inv_2_accel * (nominal_speed_sqr - pl_block->entry_speed_sqr);
+                                prep.accelerate_until -= inv_2_accel * (nominal_speed_sqr - pl_kin->entry_speed_sqr);
                             }
                         } else {  // Triangle type
                             prep.accelerate_until = intersect_distance;
                             prep.decelerate_after = intersect_distance;
-                            prep.maximum_speed    = sqrtf(2.0f * pl_block->acceleration * intersect_distance + exit_speed_sqr);
+                            prep.maximum_speed    = sqrtf(2.0f * pl_kin->acceleration * intersect_distance + exit_speed_sqr);
                         }
                     } else {  // Deceleration-only type
                         prep.ramp_type = RAMP_DECEL;
-                        // prep.decelerate_after = pl_block->millimeters;
+                        // prep.decelerate_after = pl_kin->millimeters;
                         // prep.maximum_speed = prep.current_speed;
                     }
                 } else {  // Acceleration-only type
@@ -535,7 +1077,7 @@ void Stepper::prep_buffer() {
         }
 
         // Initialize new segment
-        volatile segment_t* prep_segment = &segment_buffer[segment_buffer_head];
+        volatile segment_t* prep_segment = &segment_buffer[segment_buffer_head.load(std::memory_order_relaxed)];
 
         // Set new segment to point to the current segment data block.
         prep_segment->st_block_index = prep.st_block_index;
@@ -559,23 +1101,36 @@ void Stepper::prep_buffer() {
         float time_var = dt_max;                                    // Time worker variable
         float mm_var;                                               // mm-Distance worker variable
         float speed_var;                                            // Speed worker variable
-        float mm_remaining = pl_block->millimeters;                 // New segment distance from end of block.
+        float mm_remaining = pl_kin->millimeters;                   // New segment distance from end of block.
         float minimum_mm   = mm_remaining - prep.req_mm_increment;  // Guarantee at least one step.
 
         if (minimum_mm < 0.0) {
             minimum_mm = 0.0;
         }
 
+        if (Stepping::_adaptiveSegments) {
+            if (prep.ramp_type == RAMP_CRUISE) {
+                // The speed does not change during a cruise, so fewer, longer segments are as exact.
+                // The segment ends with the cruise, so the deceleration gets short segments.
+                float cruise_time = (mm_remaining - prep.decelerate_after) / prep.maximum_speed;
+                dt_max            = MAX(DT_SEGMENT, MIN(cruise_time, (depth - 1) * DT_SEGMENT / 4));
+            } else {
+                // Shorter segments follow the speed changes of the ramps more closely
+                dt_max = DT_SEGMENT / 2;
+            }
+            time_var = dt_max;
+        }
+
         do {
             switch (prep.ramp_type) {
                 case RAMP_DECEL_OVERRIDE:
-                    speed_var = pl_block->acceleration * time_var;
+                    speed_var = pl_kin->acceleration * time_var;
                     mm_var    = time_var * (prep.current_speed - 0.5f * speed_var);
                     mm_remaining -= mm_var;
                     if ((mm_remaining < prep.accelerate_until) || (mm_var <= 0)) {
                         // Cruise or cruise-deceleration types only for deceleration override.
                         mm_remaining       = prep.accelerate_until;  // NOTE: 0.0 at EOB
-                        time_var           = 2.0f * (pl_block->millimeters - mm_remaining) / (prep.current_speed + prep.maximum_speed);
+                        time_var           = 2.0f * (pl_kin->millimeters - mm_remaining) / (prep.current_speed + prep.maximum_speed);
                         prep.ramp_type     = RAMP_CRUISE;
                         prep.current_speed = prep.maximum_speed;
                     } else {  // Mid-deceleration override ramp.
@@ -583,13 +1138,26 @@ void Stepper::prep_buffer() {
                     }
                     break;
                 case RAMP_ACCEL:
+                    if (prep.shaped) {
+                        if (ramp_advance(time_var, mm_remaining, prep.accelerate_until)) {
+                            mm_remaining = prep.accelerate_until;
+                            if (mm_remaining == prep.decelerate_after) {
+                                prep.ramp_type = RAMP_DECEL;
+                                ramp_start(prep.maximum_speed, prep.exit_speed, mm_remaining, prep.shape_decel);
+                            } else {
+                                prep.ramp_type = RAMP_CRUISE;
+                            }
+                            prep.current_speed = prep.maximum_speed;
+                        }
+                        break;
+                    }
                     // NOTE: Acceleration ramp only computes during first do-while loop.
-                    speed_var = pl_block->acceleration * time_var;
+                    speed_var = pl_kin->acceleration * time_var;
                     mm_remaining -= time_var * (prep.current_speed + 0.5f * speed_var);
                     if (mm_remaining < prep.accelerate_until) {  // End of acceleration ramp.
                         // Acceleration-cruise, acceleration-deceleration ramp junction, or end of block.
                         mm_remaining = prep.accelerate_until;  // NOTE: 0.0 at EOB
-                        time_var     = 2.0f * (pl_block->millimeters - mm_remaining) / (prep.current_speed + prep.maximum_speed);
+                        time_var     = 2.0f * (pl_kin->millimeters - mm_remaining) / (prep.current_speed + prep.maximum_speed);
                         if (mm_remaining == prep.decelerate_after) {
                             prep.ramp_type = RAMP_DECEL;
                         } else {
@@ -610,14 +1178,24 @@ void Stepper::prep_buffer() {
                         time_var       = (mm_remaining - prep.decelerate_after) / prep.maximum_speed;
                         mm_remaining   = prep.decelerate_after;  // NOTE: 0.0 at EOB
                         prep.ramp_type = RAMP_DECEL;
+                        if (prep.shaped) {
+                            ramp_start(prep.maximum_speed, prep.exit_speed, mm_remaining, prep.shape_decel);
+                        }
                     } else {  // Cruising only.
                         mm_remaining = mm_var;
                     }
                     break;
                 default:  // case RAMP_DECEL:
+                    if (prep.shaped) {
+                        if (ramp_advance(time_var, mm_remaining, prep.mm_complete)) {
+                            mm_remaining       = prep.mm_complete;
+                            prep.current_speed = prep.exit_speed;
+                        }
+                        break;
+                    }
                     // NOTE: mm_var used as a misc worker variable to prevent errors when near zero speed.
-                    speed_var = pl_block->acceleration * time_var;  // Used as delta speed (mm/min)
-                    if (prep.current_speed > speed_var) {           // Check if at or below zero speed.
+                    speed_var = pl_kin->acceleration * time_var;  // Used as delta speed (mm/min)
+                    if (prep.current_speed > speed_var) {         // Check if at or below zero speed.
                         // Compute distance from end of segment to end of block.
                         mm_var = mm_remaining - time_var * (prep.current_speed - 0.5f * speed_var);  // (mm)
                         if (mm_var > prep.mm_complete) {                                             // Typical case. In deceleration ramp.
@@ -669,8 +1247,8 @@ void Stepper::prep_buffer() {
             }
             sys.step_control.updateSpindleSpeed = false;
         }
-        prep_segment->spindle_speed     = prep.current_spindle_speed;
-        prep_segment->spindle_dev_speed = spindle->mapSpeed(prep.current_spindle_speed);  // Reload segment PWM value
+        uint32_t dev_speed          = spindle->mapSpeed(prep.current_spindle_speed);  // At the end of the segment
+        prep_segment->spindle_speed = prep.current_spindle_speed;
 
         /* -----------------------------------------------------------------------------------
            Compute segment step rate, steps to execute, and apply necessary rate corrections.
@@ -717,30 +1295,48 @@ void Stepper::prep_buffer() {
         // fStepperTimer is in units of timerTicks/sec, so the dimensional analysis is
         // timerTicks/sec * 60 sec/minute * minutes = timerTicks
         uint32_t timerTicks = uint32_t(ceilf((Machine::Stepping::fStepperTimer * 60) * inv_rate));  // (timerTicks/step)
-        int      level;
+        uint32_t level;
 
         // Compute step timing and multi-axis smoothing level.
-        for (level = 0; level < maxAmassLevel; level++) {
-            if (timerTicks < amassThreshold) {
+        for (level = 0; level < amass_levels; level++) {
+            if (timerTicks < amass_threshold) {
                 break;
             }
             timerTicks >>= 1;
         }
         prep_segment->amass_level = level;
         prep_segment->n_step <<= level;
-        // isrPeriod is stored as 16 bits, so limit timerTicks to the
-        // largest value that will fit in a uint16_t.
-        prep_segment->isrPeriod = timerTicks > 0xffff ? 0xffff : timerTicks;
+        // isrPeriod has 32 bits, so steps slower than the last AMASS level are still timed exactly
+        prep_segment->isrPeriod = timerTicks;
+
+        // With stepping/laser_interpolation, the ISR ramps the laser power from its value at the end of
+        // the previous segment to the value for the end of this one, instead of holding the end value
+        // for the whole segment.  The 32-bit ISR ramp limits this to speeds below SPINDLE_INTERPOLATION_LIMIT.
+        int32_t dev_step = 0;
+        if (Stepping::_laserInterpolation && st_prep_block->is_pwm_rate_adjusted && prep_segment->n_step &&
+            dev_speed < SPINDLE_INTERPOLATION_LIMIT && prep.last_dev_speed < SPINDLE_INTERPOLATION_LIMIT) {
+            int64_t change = int64_t(dev_speed) - int64_t(prep.last_dev_speed);
+            dev_step       = int32_t(change * (1 << SPINDLE_FRACTION_BITS) / prep_segment->n_step);
+        }
+        uint32_t start_speed            = dev_step ? prep.last_dev_speed : dev_speed;
+        prep_segment->spindle_dev_speed = start_speed;  // Reload segment PWM value
+        prep_segment->spindle_dev_step  = dev_step;
+        prep_segment->spindle_changed   = start_speed != prep.last_dev_speed;
+        prep.last_dev_speed             = dev_speed;
+
+        prep_segment->start_ticks = prep.queued_ticks;
+        prep.queued_ticks += uint32_t(prep_segment->n_step) * prep_segment->isrPeriod;
 
         // Segment complete! Increment segment buffer indices, so stepper ISR can immediately execute it.
-        auto lastseg        = segment_next_head;
-        segment_next_head   = segment_next_head >= (Stepping::_segments - 1) ? 0 : segment_next_head + 1;
-        segment_buffer_head = lastseg;
+        auto lastseg      = segment_next_head;
+        segment_next_head = segment_next_head >= (n_segments - 1) ? 0 : segment_next_head + 1;
+        segment_buffer_head.store(lastseg, std::memory_order_release);
 
         // Update the appropriate planner and segment data.
-        pl_block->millimeters = mm_remaining;
-        prep.steps_remaining  = n_steps_remaining;
-        prep.dt_remainder     = (n_steps_remaining - step_dist_remaining) * inv_rate;
+        pl_kin->millimeters  = mm_remaining;
+        prep.steps_remaining = n_steps_remaining;
+        prep.dt_remainder    = (n_steps_remaining - step_dist_remaining) * inv_rate;
+        prep.peak_speed      = MAX(prep.peak_speed, prep.current_speed);
         // Check for exit conditions and flag to load next planner block.
         if (mm_remaining == prep.mm_complete) {
             // End of planner block or forced-termination. No more distance to be executed.
@@ -764,6 +1360,26 @@ void Stepper::prep_buffer() {
             }
         }
     }
+    // The buffer is full, and has until the next call to drain
+    exit_ahead = time_ahead();
+}
+
+uint64_t Stepper::discard_segments(float& peak_speed) {
+    uint64_t ticks = 0;
+    uint32_t tail  = segment_buffer_tail.load(std::memory_order_relaxed);
+    while (tail != segment_buffer_head.load(std::memory_order_acquire)) {
+        segment_t& segment = segment_buffer[tail];
+        ticks += uint64_t(segment.n_step) * segment.isrPeriod;
+        // Leave the block index where the ISR would have, so that the next segment it loads
+        // after a new block still resets the Bresenham counters
+        st.exec_block_index = segment.st_block_index;
+        st.exec_block       = &st_block_buffer[st.exec_block_index];
+        tail                = tail >= (n_segments - 1) ? 0 : tail + 1;
+        segment_buffer_tail.store(tail, std::memory_order_release);
+    }
+    peak_speed      = MAX(peak_speed, prep.peak_speed);
+    prep.peak_speed = 0;
+    return ticks;
 }
 
 // Called by realtime status reporting to fetch the current speed being executed. This value
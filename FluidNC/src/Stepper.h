@@ -12,12 +12,16 @@
 #include "EnumItem.h"
 
 #include <cstdint>
+#include <mutex>
 
 namespace Stepper {
     void init();
 
     bool pulse_func();
 
+    // Chooses the pulse_func() code for the configured axes and motors.  Called after the motors are assigned.
+    void select_pulse_func();
+
     // Enable steppers, but cycle does not start unless called by motion control or realtime command.
     void wake_up();
 
@@ -36,11 +40,35 @@ namespace Stepper {
     // Restores the step segment buffer to the normal run state after a parking motion.
     void parking_restore_buffer();
 
-    // Reloads step segment buffer. Called continuously by realtime execution system.
+    // Reloads step segment buffer. Called continuously by realtime execution system,
+    // and by the prep task if stepping/prep_task is enabled.
     void prep_buffer();
 
+    // True in the states where the step segment buffer needs to be kept full
+    bool prep_state();
+
+    // Held by prep_buffer() and by the code that changes the planner blocks or the motion
+    // state that it works from, so the prep task cannot run in the middle of those changes.
+    extern std::recursive_mutex prep_mutex;
+
+    // Times that the step ISR ran out of segments in the middle of a planner block
+    extern volatile uint32_t underruns;
+
+    // Segment loads where the step ISR left the spindle alone because its speed was unchanged
+    extern volatile uint32_t spindle_updates_skipped;
+
+    // Segments that prep_buffer() keeps in the buffer, which stepping/auto_segments adjusts
+    uint32_t segment_depth();
+
     // Called by planner_recalculate() when the executing block is updated by the new plan.
-    bool update_plan_block_parameters();
+    // With keepRamp, a shaped ramp in progress runs to its end instead of being restarted,
+    // which would jump its acceleration; the block then keeps its old exit speed.
+    bool update_plan_block_parameters(bool keepRamp = false);
+
+    // Drops the prepared segments as if the step ISR had executed them, for the job time
+    // estimator. Returns their duration in step timer ticks, and raises peak_speed (mm/min)
+    // to the fastest speed reached since the last call.
+    uint64_t discard_segments(float& peak_speed);
 
     // Called by realtime status reporting if realtime rate reporting is enabled in config.h.
     float get_realtime_rate();
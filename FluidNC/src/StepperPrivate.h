@@ -11,6 +11,12 @@ const int   RAMP_CRUISE             = 1;
 const int   RAMP_DECEL              = 2;
 const int   RAMP_DECEL_OVERRIDE     = 3;
 
+// Fraction bits of the device speed that the ISR interpolates with stepping/laser_interpolation.
+// Only device speeds below SPINDLE_INTERPOLATION_LIMIT fit in an int32_t with them; faster
+// segments hold their end speed instead.
+const int      SPINDLE_FRACTION_BITS       = 12;
+const uint32_t SPINDLE_INTERPOLATION_LIMIT = uint32_t(1) << (31 - SPINDLE_FRACTION_BITS);
+
 struct PrepFlag {
     uint8_t recalculate : 1;
     uint8_t holdPartialBlock : 1;
@@ -18,7 +24,7 @@ struct PrepFlag {
     uint8_t decelOverride : 1;
 };
 
-// Define Adaptive Multi-Axis Step-Smoothing(AMASS) levels and cutoff frequencies. The highest level
+// Adaptive Multi-Axis Step-Smoothing (AMASS) levels and cutoff frequencies. The highest level
 // frequency bin starts at 0Hz and ends at its cutoff frequency. The next lower level frequency bin
 // starts at the next higher cutoff frequency, and so on. The cutoff frequencies for each level must
 // be considered carefully against how much it over-drives the stepper ISR, the accuracy of the 16-bit
@@ -26,8 +32,8 @@ struct PrepFlag {
 // Level 1 cutoff frequency and up to as fast as the CPU allows (over 30kHz in limited testing).
 // For efficient computation, each cutoff frequency is twice the previous one.
 // NOTE: AMASS cutoff frequency multiplied by ISR overdrive factor must not exceed maximum step frequency.
-// NOTE: Current settings are set to overdrive the ISR to no more than 16kHz, balancing CPU overhead
-// and timer accuracy.  Do not alter these settings unless you know what you are doing.
+// The level 1 cutoff is set by Stepper::init() to this fraction of the step engine's maximum pulse
+// rate, so the ISR is overdriven to no more than an eighth of that rate.  The number of levels is
+// stepping/amass_levels.
 
-const uint32_t amassThreshold = Machine::Stepping::fStepperTimer / 8000;
-const int      maxAmassLevel  = 3;  // Each level increase doubles the threshold
+const uint32_t AMASS_CUTOFF_DIVISOR = 16;
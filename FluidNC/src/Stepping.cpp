@@ -8,6 +8,12 @@
 step_engine_t* step_engines = NULL;  // Linked list of stepping engines
 
 step_engine_t* find_engine(const char* name) {
+    // An exact match wins over a substring match, so that I2S_STREAM does not resolve to I2S
+    for (step_engine_t* p = step_engines; p; p = p->link) {
+        if (strcmp(name, p->name) == 0) {
+            return p;
+        }
+    }
     for (step_engine_t* p = step_engines; p; p = p->link) {
         // Initial substring match, handles different forms of I2S
         if (strncmp(name, p->name, strlen(p->name)) == 0) {
@@ -26,8 +32,13 @@ namespace Machine {
 
     AxisMask Stepping::direction_mask = 0;
 
-    bool   Stepping::_switchedStepper = false;
-    size_t Stepping::_segments        = 12;
+    bool     Stepping::_switchedStepper    = false;
+    uint32_t Stepping::_segments           = 12;
+    bool     Stepping::_prepTask           = true;
+    bool     Stepping::_adaptiveSegments   = false;
+    bool     Stepping::_autoSegments       = false;
+    uint32_t Stepping::_amassLevels        = 3;
+    bool     Stepping::_laserInterpolation = false;
 
     uint32_t Stepping::_idleMsecs           = 255;
     uint32_t Stepping::_pulseUsecs          = 4;
@@ -40,13 +51,14 @@ namespace Machine {
                                    { Stepping::RMT_ENGINE, "RMT" },
                                    { Stepping::I2S_STATIC, "I2S_STATIC" },
                                    { Stepping::I2S_STREAM, "I2S_STREAM" },
+                                   { Stepping::CAPTURE, "Capture" },
                                    EnumItem(Stepping::RMT_ENGINE) };
 
     void Stepping::afterParse() {
         const char* name = stepTypes[_engine].name;
         step_engine      = find_engine(name);
         Assert(step_engine, "Cannot find stepping engine for %s", name);
-        Assert(strcmp("I2S", name) || config->_i2so, "I2SO bus must be configured for this stepping type");
+        Assert(strncmp("I2S", name, 3) || config->_i2so, "I2SO bus must be configured for this stepping type");
     }
 
     void Stepping::init() {
@@ -54,6 +66,7 @@ namespace Machine {
                              << "us Dir Delay:" << _directionDelayUsecs << "us Idle Delay:" << _idleMsecs << "ms");
 
         uint32_t actual = step_engine->init(_directionDelayUsecs, _pulseUsecs, fStepperTimer, Stepper::pulse_func);
+        Assert(actual != STEP_ENGINE_INIT_FAILED, "Cannot start the %s stepping engine", stepTypes[_engine].name);
         if (actual != _pulseUsecs) {
             log_warn("stepping/pulse_us adjusted to " << actual);
         }
@@ -120,21 +133,28 @@ void Stepping::unlimit(int axis, int motor) {
     }
 }
 
+// Direction bits most recently written to the pins, shared by all of the step() instances
+static uint8_t previous_dir_mask = 255;  // should never be this value
+
+template <size_t n_axis, bool ganged>
 void IRAM_ATTR Stepping::step(uint8_t step_mask, uint8_t dir_mask) {
+    // With no second motors, only motor 0 needs to be considered
+    const size_t n_motors = ganged ? MAX_MOTORS_PER_AXIS : 1;
+
     // Set the direction pins, but optimize for the common
     // situation where the direction bits haven't changed.
-    static uint8_t previous_dir_mask = 255;  // should never be this value
     if (previous_dir_mask == 255) {
         // Set all the direction bits the first time
         previous_dir_mask = ~dir_mask;
     }
 
     if (dir_mask != previous_dir_mask) {
-        for (size_t axis = 0; axis < Axes::_numberAxis; axis++) {
+#pragma GCC unroll MAX_N_AXIS
+        for (size_t axis = 0; axis < n_axis; axis++) {
             bool dir     = bitnum_is_true(dir_mask, axis);
             bool old_dir = bitnum_is_true(previous_dir_mask, axis);
             if (dir != old_dir) {
-                for (size_t motor = 0; motor < MAX_MOTORS_PER_AXIS; motor++) {
+                for (size_t motor = 0; motor < n_motors; motor++) {
                     auto m = axis_motors[axis][motor];
                     if (m) {
                         step_engine->set_dir_pin(m->dir_pin, dir ^ m->dir_invert);
@@ -150,11 +170,12 @@ void IRAM_ATTR Stepping::step(uint8_t step_mask, uint8_t dir_mask) {
     step_engine->start_step();
 
     // Turn on step pulses for motors that are supposed to step now
-    for (size_t axis = 0; axis < Axes::_numberAxis; axis++) {
+#pragma GCC unroll MAX_N_AXIS
+    for (size_t axis = 0; axis < n_axis; axis++) {
         if (bitnum_is_true(step_mask, axis)) {
             auto increment = bitnum_is_true(dir_mask, axis) ? -1 : 1;
             axis_steps[axis] += increment;
-            for (size_t motor = 0; motor < MAX_MOTORS_PER_AXIS; motor++) {
+            for (size_t motor = 0; motor < n_motors; motor++) {
                 auto m = axis_motors[axis][motor];
                 if (m && !m->blocked && !m->limited) {
                     step_engine->set_step_pin(m->step_pin, !m->step_invert);
@@ -166,12 +187,16 @@ void IRAM_ATTR Stepping::step(uint8_t step_mask, uint8_t dir_mask) {
 }
 
 // Turn all stepper pins off
+template <size_t n_axis, bool ganged>
 void IRAM_ATTR Stepping::unstep() {
+    const size_t n_motors = ganged ? MAX_MOTORS_PER_AXIS : 1;
+
     if (step_engine->start_unstep()) {
         return;
     }
-    for (size_t axis = 0; axis < Axes::_numberAxis; axis++) {
-        for (size_t motor = 0; motor < MAX_MOTORS_PER_AXIS; motor++) {
+#pragma GCC unroll MAX_N_AXIS
+    for (size_t axis = 0; axis < n_axis; axis++) {
+        for (size_t motor = 0; motor < n_motors; motor++) {
             auto m = axis_motors[axis][motor];
             if (m) {
                 step_engine->set_step_pin(m->step_pin, m->step_invert);
@@ -181,6 +206,33 @@ void IRAM_ATTR Stepping::unstep() {
     step_engine->finish_unstep();
 }
 
+// Motors are only assigned to configured axes, so this covers them all
+void IRAM_ATTR Stepping::unstep() {
+    unstep<MAX_N_AXIS, true>();
+}
+
+bool Stepping::ganged() {
+    for (size_t axis = 0; axis < MAX_N_AXIS; axis++) {
+        if (axis_motors[axis][1]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The instances that Stepper::pulse_func() can use
+#define STEPPING_INSTANCES(n)                                                    \
+    template void Stepping::step<n, false>(uint8_t step_mask, uint8_t dir_mask); \
+    template void Stepping::step<n, true>(uint8_t step_mask, uint8_t dir_mask);  \
+    template void Stepping::unstep<n, false>();                                  \
+    template void Stepping::unstep<n, true>();
+STEPPING_INSTANCES(1)
+STEPPING_INSTANCES(2)
+STEPPING_INSTANCES(3)
+STEPPING_INSTANCES(4)
+STEPPING_INSTANCES(5)
+STEPPING_INSTANCES(6)
+
 void Stepping::reset() {}
 void Stepping::beginLowLatency() {}
 void Stepping::endLowLatency() {}
@@ -208,6 +260,11 @@ void Stepping::group(Configuration::HandlerBase& handler) {
     handler.item("dir_delay_us", _directionDelayUsecs, 0, 10);
     handler.item("disable_delay_us", _disableDelayUsecs, 0, 1000000);  // max 1 second
     handler.item("segments", _segments, 6, 20);
+    handler.item("prep_task", _prepTask);
+    handler.item("adaptive_segments", _adaptiveSegments);
+    handler.item("auto_segments", _autoSegments);
+    handler.item("amass_levels", _amassLevels, 0, 6);
+    handler.item("laser_interpolation", _laserInterpolation);
 }
 
 uint32_t Stepping::maxPulsesPerSec() {
@@ -41,6 +41,7 @@ namespace Machine {
             RMT_ENGINE,
             I2S_STATIC,
             I2S_STREAM,
+            CAPTURE,
         };
 
         Stepping() = default;
@@ -50,9 +51,29 @@ namespace Machine {
         // fixed time defined by ACCELERATION_TICKS_PER_SECOND. They are computed such that the planner
         // block velocity profile is traced exactly. The size of this buffer governs how much step
         // execution lead time there is for other processes to run.  The latency for a feedhold or other
-        // override is roughly 10 ms times _segments.
+        // override is roughly 10 ms times _segments.  With _autoSegments, _segments is the upper limit.
 
-        static size_t _segments;
+        static uint32_t _segments;
+
+        // Whether a separate task, rather than only the main loop, keeps the segment buffer full
+        static bool _prepTask;
+
+        // Whether segment times vary with the velocity profile: half as long during
+        // acceleration ramps, and up to a quarter of the buffer time during cruise.  The
+        // buffer is filled to the same time as with fixed-length segments.
+        static bool _adaptiveSegments;
+
+        // Whether the buffer depth follows the measured time between refills, keeping
+        // twice the worst of it in the buffer.  _segments is then the largest depth.
+        static bool _autoSegments;
+
+        // Most AMASS levels, each of which doubles the ISR rate of slow segments to smooth the
+        // steps of the minor axes
+        static uint32_t _amassLevels;
+
+        // Whether the step ISR ramps the laser power across each segment in M4 mode, rather than
+        // changing it in steps at segment boundaries
+        static bool _laserInterpolation;
 
         static uint32_t _idleMsecs;
         static uint32_t _pulseUsecs;
@@ -73,9 +94,17 @@ namespace Machine {
         static void beginLowLatency();
         static void endLowLatency();
 
+        // n_axis and ganged are compile-time so that pulse_func() variants get unrolled loops.
+        // unstep() without arguments handles any configuration.
+        template <size_t n_axis, bool ganged>
         static void step(uint8_t step_mask, uint8_t dir_mask);
+        template <size_t n_axis, bool ganged>
+        static void unstep();
         static void unstep();
 
+        // True if any axis has a second motor
+        static bool ganged();
+
         // Used to stop a motor quickly when a limit switch is hit
         static bool* limit_var(int axis, int motor);
         static void  limit(int axis, int motor);
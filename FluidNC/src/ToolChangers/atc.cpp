@@ -8,7 +8,7 @@
 ATCs::ATC* atc = nullptr;
 
 namespace ATCs {
-    void probe_notification() {}
+    void ATC::probe_notification() {}
 
     bool tool_change(uint8_t value, bool pre_select) {
         return true;
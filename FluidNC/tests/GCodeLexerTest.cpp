@@ -0,0 +1,64 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+#include "gtest/gtest.h"
+#include "src/GCodeLexer.h"
+
+static int lex(const char* line, gc_word_t* words) {
+    return gc_lex_line(line, words, MAX_GCODE_WORDS);
+}
+
+TEST(GCodeLexer, PlainLine) {
+    gc_word_t words[MAX_GCODE_WORDS];
+    ASSERT_EQ(lex("g1 X1.5 y-2", words), 3);
+    EXPECT_EQ(words[0].letter, 'G');
+    EXPECT_EQ(words[0].value, 1.0f);
+    EXPECT_EQ(words[1].letter, 'X');
+    EXPECT_EQ(words[1].value, 1.5f);
+    EXPECT_EQ(words[2].letter, 'Y');
+    EXPECT_EQ(words[2].value, -2.0f);
+}
+
+TEST(GCodeLexer, Comments) {
+    gc_word_t words[MAX_GCODE_WORDS];
+    ASSERT_EQ(lex("G1 (move) X10 ; to the end", words), 2);
+    EXPECT_EQ(words[1].letter, 'X');
+    EXPECT_EQ(words[1].value, 10.0f);
+    EXPECT_EQ(lex("(just a comment)", words), 0);
+    EXPECT_EQ(lex("G0 X1 (unterminated", words), 2);
+}
+
+TEST(GCodeLexer, MessageComments) {
+    gc_word_t words[MAX_GCODE_WORDS];
+    EXPECT_EQ(lex("G1 X1 (MSG,hello)", words), -1);
+    EXPECT_EQ(lex("(print,hello) G1 X1", words), -1);
+    EXPECT_EQ(lex("(DEBUG,x)", words), -1);
+}
+
+TEST(GCodeLexer, NestedParenthesis) {
+    gc_word_t words[MAX_GCODE_WORDS];
+    // collapseGCode() restarts the comment at the inner (, so it prints the message
+    EXPECT_EQ(lex("G1 X1 Y2 (note (PRINT,hello))", words), -1);
+    EXPECT_EQ(lex("G1 X1 (a (b) c)", words), -1);
+}
+
+TEST(GCodeLexer, SemicolonInComment) {
+    gc_word_t words[MAX_GCODE_WORDS];
+    // collapseGCode() ends the line at the ;, so X10 is not executed
+    EXPECT_EQ(lex("(a;b) G1 X10", words), -1);
+    EXPECT_EQ(lex("G1 X1 (50%)", words), -1);
+}
+
+TEST(GCodeLexer, NeedsFullParser) {
+    gc_word_t words[MAX_GCODE_WORDS];
+    EXPECT_EQ(lex("G1 X#1", words), -1);
+    EXPECT_EQ(lex("G1 X[1+2]", words), -1);
+    EXPECT_EQ(lex("o100 sub", words), -1);
+    EXPECT_EQ(lex("$J=X10 F100", words), -1);
+    EXPECT_EQ(lex("G1 X1 2", words), -1);
+}
+
+TEST(GCodeLexer, StrayCloseParenthesis) {
+    gc_word_t words[MAX_GCODE_WORDS];
+    ASSERT_EQ(lex("G1 ) X3", words), 2);
+    EXPECT_EQ(words[1].value, 3.0f);
+}
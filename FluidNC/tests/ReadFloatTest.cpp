@@ -0,0 +1,154 @@
+// Use of this source code is governed by a GPLv3 license that can be found in the LICENSE file.
+
+#include "gtest/gtest.h"
+#include "src/ReadFloat.h"
+
+#include <cctype>
+#include <cstring>
+#include <string>
+
+// read_float() as it was before the one-test-per-digit fast path, which the fast path must match
+static bool read_float_reference(const char* line, size_t& pos, float& result) {
+    const char* ptr = line + pos;
+
+    char c          = *ptr;
+    bool isnegative = false;
+    if (c == '-') {
+        ++ptr;
+        isnegative = true;
+    } else if (c == '+') {
+        ++ptr;
+    }
+
+    uint32_t intval    = 0;
+    int8_t   exp       = 0;
+    size_t   ndigit    = 0;
+    bool     isdecimal = false;
+    while (1) {
+        c = *ptr;
+        if (isdigit(c)) {
+            ++ptr;
+            ndigit++;
+            if (ndigit <= 8) {
+                if (isdecimal) {
+                    exp--;
+                }
+                intval = intval * 10 + c - '0';
+            } else {
+                if (!(isdecimal)) {
+                    exp++;  // Drop overflow digits
+                }
+            }
+        } else if (c == '.' && !(isdecimal)) {
+            ++ptr;
+            isdecimal = true;
+        } else {
+            break;
+        }
+    }
+    if (!ndigit) {
+        return false;
+    }
+
+    float fval = uint_to_float(intval, exp);
+
+    result = isnegative ? -fval : fval;
+
+    pos = ptr - line;
+    return true;
+}
+
+// Reads the number at the start of text both ways, and checks that they agree bit for bit
+static void expect_same(const std::string& text) {
+    SCOPED_TRACE(text);
+    // The word letter in front checks that pos is honored
+    std::string line      = "X" + text;
+    size_t      pos       = 1;
+    size_t      ref_pos   = 1;
+    float       value     = -1.0f;
+    float       ref_value = -1.0f;
+    bool        ok        = read_float(line.c_str(), pos, value);
+    bool        ref_ok    = read_float_reference(line.c_str(), ref_pos, ref_value);
+    ASSERT_EQ(ok, ref_ok);
+    EXPECT_EQ(pos, ref_pos);
+    if (ok) {
+        uint32_t bits, ref_bits;
+        memcpy(&bits, &value, sizeof(bits));
+        memcpy(&ref_bits, &ref_value, sizeof(ref_bits));
+        EXPECT_EQ(bits, ref_bits) << value << " vs " << ref_value;
+    }
+}
+
+TEST(ReadFloat, PlainValues) {
+    for (const char* text : { "0", "1", "5", "10", "1.5", "123.456", "0.001", "99999999", "12345.6789" }) {
+        expect_same(text);
+    }
+}
+
+TEST(ReadFloat, Signs) {
+    for (const char* text : { "+1", "-1", "+0", "-0", "-0.0", "+.5", "-.5", "-12.5", "+", "-", "--1", "+-1", "-+1" }) {
+        expect_same(text);
+    }
+}
+
+TEST(ReadFloat, DecimalPoints) {
+    for (const char* text : { ".", "5.", "X.", "X5.", ".5", "5.5.5", "..5", "5..", "0.", ".0", "-.", "+." }) {
+        expect_same(text);
+    }
+}
+
+TEST(ReadFloat, LeadingZeros) {
+    for (const char* text : { "00", "007", "0000000001", "000000000000001.5", "0.000000001", "-0000.0001", "000000000.25" }) {
+        expect_same(text);
+    }
+}
+
+TEST(ReadFloat, LongDigitRuns) {
+    // Beyond MAX_INT_DIGITS, both paths drop the overflow digits
+    for (const char* text : { "123456789",
+                              "1234567890123",
+                              "12345678.9",
+                              "1234567.89",
+                              "0.123456789012",
+                              "99999999.99999999",
+                              "4294967295",
+                              "1234567890123456789012345678901234567890",
+                              "3.14159265358979323846264338327950288" }) {
+        expect_same(text);
+    }
+}
+
+TEST(ReadFloat, PrecisionLimit) {
+    // Values around the 24-bit mantissa of a float
+    for (const char* text : { "16777215", "16777216", "16777217", "16777218", "1677721.7", "8388607.5", "0.16777217", "33554431" }) {
+        expect_same(text);
+    }
+}
+
+TEST(ReadFloat, Terminators) {
+    for (const char* text : { "", "Y", "1Y2", "1.5Y", "2 ", "3;", "4(", "5e3", "6E3", "7#", "8[" }) {
+        expect_same(text);
+    }
+}
+
+TEST(ReadFloat, FormattedSweep) {
+    // Every count of integer and fraction digits up to twelve, with a varied digit pattern
+    for (int int_digits = 0; int_digits <= 12; int_digits++) {
+        for (int frac_digits = -1; frac_digits <= 12; frac_digits++) {
+            for (int seed = 0; seed < 10; seed++) {
+                std::string text;
+                for (int i = 0; i < int_digits; i++) {
+                    text += char('0' + (seed * 7 + i * 3) % 10);
+                }
+                if (frac_digits >= 0) {
+                    text += '.';
+                    for (int i = 0; i < frac_digits; i++) {
+                        text += char('0' + (seed * 3 + i * 7 + 1) % 10);
+                    }
+                }
+                expect_same(text);
+                expect_same("-" + text);
+            }
+        }
+    }
+}
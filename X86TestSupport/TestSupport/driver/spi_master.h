@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdint>
+
+// Opaque device handle; the host build has no SPI devices
+typedef void* spi_device_t;
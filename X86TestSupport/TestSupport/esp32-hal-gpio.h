@@ -1,6 +1,6 @@
 #pragma once
 
-#include <cstdint>
+#include <stdint.h>
 
 // Interrupt Modes
 #define RISING 0x01
@@ -77,6 +77,12 @@ void attachInterrupt(uint8_t pin, void (*)(void), int mode);
 void attachInterruptArg(uint8_t pin, void (*)(void*), void* arg, int mode);
 void detachInterrupt(uint8_t pin);
 
-extern "C" int  __digitalRead(uint8_t pin);
-extern "C" void __pinMode(uint8_t pin, uint8_t mode);
-extern "C" void __digitalWrite(uint8_t pin, uint8_t val);
+#ifdef __cplusplus
+extern "C" {
+#endif
+int  __digitalRead(uint8_t pin);
+void __pinMode(uint8_t pin, uint8_t mode);
+void __digitalWrite(uint8_t pin, uint8_t val);
+#ifdef __cplusplus
+}
+#endif
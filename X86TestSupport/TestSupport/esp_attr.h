@@ -1,3 +1,9 @@
 #pragma once
 
-#include "Arduino.h"
+#ifdef __cplusplus
+#    include "Arduino.h"
+#else
+#    define IRAM_ATTR
+#endif
+
+#define RTC_NOINIT_ATTR
@@ -1,6 +1,7 @@
-#include "Queue.h"
+#include "queue.h"
 
 #include <atomic>
+#include <cstring>
 #include <vector>
 #include <mutex>
 
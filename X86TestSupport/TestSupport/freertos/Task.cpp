@@ -1,4 +1,4 @@
-#include "Task.h"
+#include "task.h"
 
 #include "Capture.h"
 #include "../Arduino.h"
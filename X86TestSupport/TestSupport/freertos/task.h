@@ -4,6 +4,8 @@
 #include "FreeRTOS.h"
 #include "FreeRTOSTypes.h"
 
+#include <climits>
+
 void vTaskDelay(const TickType_t xTicksToDelay);
 
 #define CONFIG_ARDUINO_RUNNING_CORE 0